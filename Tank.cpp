@@ -3,74 +3,268 @@
 
 namespace Tmpl8
 {
-Tank::Tank(
+
+//Reallocates 'array' with room for 'capacity' elements, keeping the first 'count'
+template <typename T>
+static void growArray(T*& array, int count, int capacity)
+{
+    T* grown = static_cast<T*>(MALLOC64(capacity * sizeof(T)));
+    if (array != nullptr)
+    {
+        memcpy(grown, array, count * sizeof(T));
+        FREE64(array);
+    }
+    array = grown;
+}
+
+template <typename T>
+static void copyArray(T* destination, const T* source, int count)
+{
+    memcpy(destination, source, count * sizeof(T));
+}
+
+//Replaces 'array' with array[order[0]], array[order[1]], ..., array[order[count-1]]
+template <typename T>
+static void permuteArray(T*& array, const int* order, int count, int capacity)
+{
+    T* permuted = static_cast<T*>(MALLOC64(capacity * sizeof(T)));
+    for (int i = 0; i < count; i++) permuted[i] = array[order[i]];
+    FREE64(array);
+    array = permuted;
+}
+
+TankStore& TankStore::operator=(const TankStore& other)
+{
+    if (this == &other) return *this;
+
+    reserve(other.count);
+    count = other.count;
+
+    copyArray(position_x, other.position_x, count);
+    copyArray(position_y, other.position_y, count);
+    copyArray(force_x, other.force_x, count);
+    copyArray(force_y, other.force_y, count);
+    copyArray(reload_time, other.reload_time, count);
+    copyArray(health, other.health, count);
+    copyArray(active, other.active, count);
+    copyArray(current_frame, other.current_frame, count);
+    copyArray(target_x, other.target_x, count);
+    copyArray(target_y, other.target_y, count);
+    copyArray(max_speed, other.max_speed, count);
+    copyArray(collision_radius, other.collision_radius, count);
+    copyArray(allignment, other.allignment, count);
+    copyArray(tank_sprite, other.tank_sprite, count);
+
+    return *this;
+}
+
+TankStore::~TankStore()
+{
+    release();
+}
+
+void TankStore::reserve(int capacity)
+{
+    if (capacity <= this->capacity) return;
+
+    //Whole cache lines per array, aligned_alloc wants the size to be a multiple of the alignment
+    capacity = (capacity + 15) & ~15;
+
+    growArray(position_x, count, capacity);
+    growArray(position_y, count, capacity);
+    growArray(force_x, count, capacity);
+    growArray(force_y, count, capacity);
+    growArray(reload_time, count, capacity);
+    growArray(health, count, capacity);
+    growArray(active, count, capacity);
+    growArray(current_frame, count, capacity);
+    growArray(target_x, count, capacity);
+    growArray(target_y, count, capacity);
+    growArray(max_speed, count, capacity);
+    growArray(collision_radius, count, capacity);
+    growArray(allignment, count, capacity);
+    growArray(tank_sprite, count, capacity);
+
+    this->capacity = capacity;
+}
+
+void TankStore::release() noexcept
+{
+    FREE64(position_x), FREE64(position_y);
+    FREE64(force_x), FREE64(force_y);
+    FREE64(reload_time);
+    FREE64(health);
+    FREE64(active);
+    FREE64(current_frame);
+    FREE64(target_x), FREE64(target_y);
+    FREE64(max_speed);
+    FREE64(collision_radius);
+    FREE64(allignment);
+    FREE64(tank_sprite);
+}
+
+void TankStore::reorder(const int* order) noexcept
+{
+    permuteArray(position_x, order, count, capacity);
+    permuteArray(position_y, order, count, capacity);
+    permuteArray(force_x, order, count, capacity);
+    permuteArray(force_y, order, count, capacity);
+    permuteArray(reload_time, order, count, capacity);
+    permuteArray(health, order, count, capacity);
+    permuteArray(active, order, count, capacity);
+    permuteArray(current_frame, order, count, capacity);
+    permuteArray(target_x, order, count, capacity);
+    permuteArray(target_y, order, count, capacity);
+    permuteArray(max_speed, order, count, capacity);
+    permuteArray(collision_radius, order, count, capacity);
+    permuteArray(allignment, order, count, capacity);
+    permuteArray(tank_sprite, order, count, capacity);
+}
+
+int TankStore::add(
     float pos_x,
     float pos_y,
     allignments allignment,
     Sprite* tank_sprite,
-    Sprite* smoke_sprite,
     float tar_x,
     float tar_y,
     float collision_radius,
     int health,
-    float max_speed)
-    : position(pos_x, pos_y),
-      allignment(allignment),
-      target(tar_x, tar_y),
-      health(health),
-      collision_radius(collision_radius),
-      max_speed(max_speed),
-      force(0, 0),
-      reload_time(1),
-      reloaded(false),
-      speed(0),
-      active(true),
-      current_frame(0),
-      tank_sprite(tank_sprite),
-      smoke_sprite(smoke_sprite)
+    float max_speed) noexcept
 {
-}
+    if (count == capacity) reserve(max(2 * capacity, 16));
 
-Tank::~Tank()
-{
+    const int index = count++;
+    this->position_x[index] = pos_x, this->position_y[index] = pos_y;
+    this->force_x[index] = 0, this->force_y[index] = 0;
+    this->reload_time[index] = 1;
+    this->health[index] = health;
+    this->active[index] = ~0;
+    this->current_frame[index] = 0;
+    this->target_x[index] = tar_x, this->target_y[index] = tar_y;
+    this->max_speed[index] = max_speed;
+    this->collision_radius[index] = collision_radius;
+    this->allignment[index] = allignment;
+    this->tank_sprite[index] = tank_sprite;
+
+    return index;
 }
 
-void Tank::Tick()
+//All widths compute exactly what the scalar loop at the end does, in the same order, so results don't depend on the instruction set
+void TankStore::tick(const int begin, const int end) noexcept
 {
-    vec2 direction = (target - position).normalized();
+    int i = begin;
+
+#ifdef __AVX2__
+    {
+        const __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+        const __m256i one_i = _mm256_set1_epi32(1), last_frame = _mm256_set1_epi32(8);
+
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256i mask_i = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(active + i));
+            const __m256 mask = _mm256_castsi256_ps(mask_i);
+            const __m256 px = _mm256_loadu_ps(position_x + i), py = _mm256_loadu_ps(position_y + i);
+
+            //direction = (target - position).normalized()
+            const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(target_x + i), px);
+            const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(target_y + i), py);
+            const __m256 r = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy))));
+
+            //position += (direction + force) * max_speed * 0.5f
+            const __m256 speed = _mm256_loadu_ps(max_speed + i);
+            const __m256 sx = _mm256_add_ps(_mm256_mul_ps(dx, r), _mm256_loadu_ps(force_x + i));
+            const __m256 sy = _mm256_add_ps(_mm256_mul_ps(dy, r), _mm256_loadu_ps(force_y + i));
+            _mm256_storeu_ps(position_x + i, _mm256_blendv_ps(px, _mm256_add_ps(px, _mm256_mul_ps(_mm256_mul_ps(sx, speed), half)), mask));
+            _mm256_storeu_ps(position_y + i, _mm256_blendv_ps(py, _mm256_add_ps(py, _mm256_mul_ps(_mm256_mul_ps(sy, speed), half)), mask));
+
+            _mm256_storeu_ps(force_x + i, _mm256_andnot_ps(mask, _mm256_loadu_ps(force_x + i)));
+            _mm256_storeu_ps(force_y + i, _mm256_andnot_ps(mask, _mm256_loadu_ps(force_y + i)));
 
-    //Update using accumulated force
-    speed = direction + force;
-    position += speed * max_speed * 0.5f;
+            const __m256 reload = _mm256_loadu_ps(reload_time + i);
+            _mm256_storeu_ps(reload_time + i, _mm256_blendv_ps(reload, _mm256_sub_ps(reload, one), mask));
+
+            //Wrap the animation frame back to 0 after 8
+            const __m256i frame = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current_frame + i));
+            __m256i next = _mm256_add_epi32(frame, one_i);
+            next = _mm256_andnot_si256(_mm256_cmpgt_epi32(next, last_frame), next);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(current_frame + i), _mm256_blendv_epi8(frame, next, mask_i));
+        }
+    }
+#endif
 
-    //Update reload time
-    if (--reload_time <= 0.0f)
     {
-        reloaded = true;
+        //SSE2 only, so blends are done with and/andnot/or
+        const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+        const __m128i one_i = _mm_set1_epi32(1), last_frame = _mm_set1_epi32(8);
+        const auto blend = [](__m128 a, __m128 b, __m128 mask) { return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b)); };
+
+        for (; i + 4 <= end; i += 4)
+        {
+            const __m128i mask_i = _mm_loadu_si128(reinterpret_cast<const __m128i*>(active + i));
+            const __m128 mask = _mm_castsi128_ps(mask_i);
+            const __m128 px = _mm_loadu_ps(position_x + i), py = _mm_loadu_ps(position_y + i);
+
+            const __m128 dx = _mm_sub_ps(_mm_loadu_ps(target_x + i), px);
+            const __m128 dy = _mm_sub_ps(_mm_loadu_ps(target_y + i), py);
+            const __m128 r = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+
+            const __m128 speed = _mm_loadu_ps(max_speed + i);
+            const __m128 sx = _mm_add_ps(_mm_mul_ps(dx, r), _mm_loadu_ps(force_x + i));
+            const __m128 sy = _mm_add_ps(_mm_mul_ps(dy, r), _mm_loadu_ps(force_y + i));
+            _mm_storeu_ps(position_x + i, blend(px, _mm_add_ps(px, _mm_mul_ps(_mm_mul_ps(sx, speed), half)), mask));
+            _mm_storeu_ps(position_y + i, blend(py, _mm_add_ps(py, _mm_mul_ps(_mm_mul_ps(sy, speed), half)), mask));
+
+            _mm_storeu_ps(force_x + i, _mm_andnot_ps(mask, _mm_loadu_ps(force_x + i)));
+            _mm_storeu_ps(force_y + i, _mm_andnot_ps(mask, _mm_loadu_ps(force_y + i)));
+
+            const __m128 reload = _mm_loadu_ps(reload_time + i);
+            _mm_storeu_ps(reload_time + i, blend(reload, _mm_sub_ps(reload, one), mask));
+
+            const __m128i frame = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current_frame + i));
+            __m128i next = _mm_add_epi32(frame, one_i);
+            next = _mm_andnot_si128(_mm_cmpgt_epi32(next, last_frame), next);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(current_frame + i), _mm_or_si128(_mm_andnot_si128(mask_i, frame), _mm_and_si128(mask_i, next)));
+        }
     }
 
-    force = vec2(0.f, 0.f);
+    for (; i < end; i++)
+    {
+        if (!active[i]) continue;
+
+        vec2 direction = (vec2(target_x[i], target_y[i]) - vec2(position_x[i], position_y[i])).normalized();
+
+        //Update using accumulated force
+        vec2 speed = direction + vec2(force_x[i], force_y[i]);
+        position_x[i] += speed.x * max_speed[i] * 0.5f;
+        position_y[i] += speed.y * max_speed[i] * 0.5f;
 
-    if (++current_frame > 8) current_frame = 0;
+        //Update reload time
+        reload_time[i] -= 1.0f;
+
+        force_x[i] = 0.f, force_y[i] = 0.f;
+
+        if (++current_frame[i] > 8) current_frame[i] = 0;
+    }
 }
 
 //Start reloading timer
-void Tank::Reload_Rocket()
+void Tank::Reload_Rocket() const
 {
-    reloaded = false, reload_time = 200.0f;
+    store->reload_time[index] = 200.0f;
 }
 
-void Tank::Deactivate()
+void Tank::Deactivate() const
 {
-    active = false;
+    store->active[index] = 0;
 }
 
 //Remove health
-bool Tank::hit(int hit_value)
+bool Tank::hit(int hit_value) const
 {
-    health -= hit_value;
+    store->health[index] -= hit_value;
 
-    if (health <= 0)
+    if (store->health[index] <= 0)
     {
         this->Deactivate();
         return true;
@@ -80,22 +274,24 @@ bool Tank::hit(int hit_value)
 }
 
 //Draw the sprite with the facing based on this tanks movement direction
-void Tank::Draw(Surface* screen)
+void Tank::Draw(TileRenderer& renderer) const
 {
-    vec2 direction = (target - position).normalized();
-    tank_sprite->SetFrame(((abs(direction.x) > abs(direction.y)) ? ((direction.x < 0) ? 3 : 0) : ((direction.y < 0) ? 9 : 6)) + (current_frame / 3));
-    tank_sprite->Draw(screen, (int)position.x - 14, (int)position.y - 18);
+    const vec2 position = Get_Position();
+    vec2 direction = (Get_Target() - position).normalized();
+    const unsigned int frame = ((abs(direction.x) > abs(direction.y)) ? ((direction.x < 0) ? 3 : 0) : ((direction.y < 0) ? 9 : 6)) + (store->current_frame[index] / 3);
+    renderer.submit(store->tank_sprite[index], frame, (int)position.x - 14, (int)position.y - 18);
 }
 
 int Tank::CompareHealth(const Tank& other) const
 {
-    return ((health == other.health) ? 0 : ((health > other.health) ? 1 : -1));
+    return ((Get_Health() == other.Get_Health()) ? 0 : ((Get_Health() > other.Get_Health()) ? 1 : -1));
 }
 
 //Add some force in a given direction
-void Tank::Push(vec2 direction, float magnitude)
+void Tank::Push(vec2 direction, float magnitude) const
 {
-    force += direction * magnitude;
+    store->force_x[index] += direction.x * magnitude;
+    store->force_y[index] += direction.y * magnitude;
 }
 
-} // namespace Tmpl8
\ No newline at end of file
+} // namespace Tmpl8
@@ -9,51 +9,92 @@ enum allignments
     RED
 };
 
-class Tank
+class Tank; //Forward declare
+
+//Structure of arrays storage for all tanks, every field lives in its own 64 byte aligned array
+//so the per-frame passes stream through the few fields they need and can tick 8 (AVX2) or 4 (SSE) tanks at once
+class TankStore
 {
   public:
-    Tank(float pos_x, float pos_y, allignments allignment, Sprite* tank_sprite, Sprite* smoke_sprite, float tar_x, float tar_y, float collision_radius, int health, float max_speed);
-
-    ~Tank();
+    TankStore() noexcept = default;
+    TankStore(const TankStore& other) = delete;
+    TankStore& operator=(const TankStore& other);
+    ~TankStore();
+
+    void reserve(int capacity);
+    int add(float pos_x, float pos_y, allignments allignment, Sprite* tank_sprite, float tar_x, float tar_y, float collision_radius, int health, float max_speed) noexcept;
+
+    //Moves tank order[i] to index i for every tank, handles to the old indices have to be remapped by their owners
+    void reorder(const int* order) noexcept;
+
+    //Moves the active tanks in [begin, end) along their target direction plus accumulated force, then clears the force and counts down reloading
+    void tick(int begin, int end) noexcept;
+
+    int size() const noexcept { return count; }
+    Tank operator[](int index) noexcept;
+
+    //Hot, touched every frame
+    float* position_x = nullptr;
+    float* position_y = nullptr;
+    float* force_x = nullptr;
+    float* force_y = nullptr;
+    float* reload_time = nullptr;
+    int* health = nullptr;
+    int* active = nullptr; //0 or ~0, so it can be used as a SIMD mask directly
+    int* current_frame = nullptr;
+
+    //Cold, only read when targeting, colliding or drawing
+    float* target_x = nullptr;
+    float* target_y = nullptr;
+    float* max_speed = nullptr;
+    float* collision_radius = nullptr;
+    allignments* allignment = nullptr;
+    Sprite** tank_sprite = nullptr;
+
+  private:
+    int count = 0;
+    int capacity = 0;
+
+    void release() noexcept;
+};
 
-    void Tick();
+//Lightweight handle to a tank in a TankStore, cheap to copy and compare
+//Its methods are const because they change the tank in the store, never the handle itself
+class Tank
+{
+  public:
+    Tank() noexcept = default;
+    Tank(TankStore* store, int index) noexcept : store(store), index(index) {}
 
-    vec2 Get_Position() const { return position; };
-    float Get_collision_radius() const { return collision_radius; };
-    bool Rocket_Reloaded() const { return reloaded; };
+    vec2 Get_Position() const { return vec2(store->position_x[index], store->position_y[index]); };
+    vec2 Get_Target() const { return vec2(store->target_x[index], store->target_y[index]); };
+    float Get_collision_radius() const { return store->collision_radius[index]; };
+    int Get_Health() const { return store->health[index]; };
+    allignments Get_Allignment() const { return store->allignment[index]; };
+    bool Is_Active() const { return store->active[index] != 0; };
+    bool Rocket_Reloaded() const { return store->reload_time[index] <= 0.0f; };
 
-    void Reload_Rocket();
+    void Reload_Rocket() const;
 
-    void Deactivate();
-    bool hit(int hit_value);
+    void Deactivate() const;
+    bool hit(int hit_value) const;
 
-    void Draw(Surface* screen);
+    void Draw(TileRenderer& renderer) const;
 
     int CompareHealth(const Tank& other) const;
 
-    void Push(vec2 direction, float magnitude);
-
-    vec2 position;
-    vec2 speed;
-    vec2 target;
+    void Push(vec2 direction, float magnitude) const;
 
-    int health;
-
-    float collision_radius;
-    vec2 force;
-
-    float max_speed;
-    float reload_time;
-
-    bool reloaded;
-    bool active;
-
-    allignments allignment;
-
-    int current_frame;
-    Sprite* tank_sprite;
-    Sprite* smoke_sprite;
+    bool operator==(const Tank& other) const { return index == other.index && store == other.store; }
+    bool operator!=(const Tank& other) const { return !(*this == other); }
 
+    TankStore* store = nullptr;
+    int index = -1;
 };
 
-} // namespace Tmpl8
\ No newline at end of file
+inline Tank TankStore::operator[](const int index) noexcept
+{
+    return Tank(this, index);
+}
+
+} // namespace Tmpl8
@@ -0,0 +1,807 @@
+#include "precomp.h" // include (only) this in every .cpp file
+
+namespace Tmpl8
+{
+
+//Frames timed per benchmark run, after one untimed frame to warm up the containers
+const static int bench_frames = 50;
+const static int bench_grain = 1024;
+
+//Same density as the game: 2.5k tanks in the world of tanks_grid, with the same cell size and query radius
+const static float bench_cell_size = 25.f;
+const static float bench_query_radius = 7.f;
+
+// -----------------------------------------------------------
+// Incremental SpatialHasher against the rebuilt UniformGrid.
+// Every frame all tanks take a small random step, the container
+// is brought up to date and then every tank counts its neighbours.
+// Runs on 'threads' threads, one per hardware thread when 0.
+// -----------------------------------------------------------
+static bool benchGrid(const int threads)
+{
+    ThreadPool pool{(threads > 0 ? unsigned(threads) : max(1u, thread::hardware_concurrency())) - 1};
+
+    printf("%10s %12s %12s %12s %12s %12s %12s %8s\n", "tanks", "hash update", "hash query", "hash total", "grid update", "grid query", "grid total", "chunks");
+
+    bool matches = true;
+    for (const int count : {2500, 25000, 250000})
+    {
+        const float scale = sqrtf(count / 2500.f);
+        const BoundingBox world = {{-100, -100}, {-100 + 1500 * scale, -100 + 1800 * scale}};
+
+        mt19937 rng(count);
+        uniform_real_distribution<float> place_x(0, 1300 * scale), place_y(0, 1600 * scale), step(-1.5f, 1.5f);
+
+        vector<vec2> positions(count), old_positions(count);
+        for (auto& position : positions) position = {place_x(rng), place_y(rng)};
+
+        //Steps are drawn up front so both containers see the exact same motion
+        vector<vec2> steps(size_t(count) * (bench_frames + 1));
+        for (auto& s : steps) s = {step(rng), step(rng)};
+
+        auto hash = make_unique<SpatialHasher<int>>(world, bench_cell_size);
+        UniformGrid<int> grid(world, bench_cell_size);
+
+        for (int i = 0; i < count; i++) hash->tryInsertAt(positions[i], i);
+        const vector<vec2> start_positions = positions;
+
+        float hash_update = 0, hash_query = 0, grid_update = 0, grid_query = 0;
+        long long hash_neighbours = 0, grid_neighbours = 0;
+        vector<int> neighbours(count);
+
+        auto countNeighbours = [&](const auto& container) {
+            pool.parallel_for(0, count, bench_grain, [&](int start, int end) noexcept {
+                for (int i = start; i < end; i++)
+                {
+                    int found = 0;
+                    container.forEachWithinBounds({positions[i], bench_query_radius}, [&](const auto& entry) noexcept { if (entry.object != i) found++; });
+                    neighbours[i] = found;
+                }
+            });
+
+            long long sum = 0;
+            for (const int n : neighbours) sum += n;
+            return sum;
+        };
+
+        auto move = [&](int frame) {
+            old_positions = positions;
+            const vec2* frame_steps = &steps[size_t(frame) * count];
+            for (int i = 0; i < count; i++) positions[i] += frame_steps[i];
+        };
+
+        for (int frame = 0; frame <= bench_frames; frame++)
+        {
+            move(frame);
+
+            timer t;
+            pool.parallel_for(0, count, bench_grain, [&](int start, int end) noexcept {
+                for (int i = start; i < end; i++) hash->tryUpdateAt(old_positions[i], positions[i], i);
+            });
+            const float update = t.elapsed();
+
+            t.reset();
+            const long long sum = countNeighbours(*hash);
+            const float query = t.elapsed();
+
+            if (frame > 0) hash_update += update, hash_query += query, hash_neighbours += sum;
+        }
+
+        positions = start_positions;
+        for (int frame = 0; frame <= bench_frames; frame++)
+        {
+            move(frame);
+
+            timer t;
+            grid.rebuild(pool, count, [&](int i) noexcept { return UniformGrid<int>::Entry{positions[i], i}; });
+            const float update = t.elapsed();
+
+            t.reset();
+            const long long sum = countNeighbours(grid);
+            const float query = t.elapsed();
+
+            if (frame > 0) grid_update += update, grid_query += query, grid_neighbours += sum;
+        }
+
+        const float frames = float(bench_frames);
+        printf("%10d %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f %8d\n", count,
+               hash_update / frames, hash_query / frames, (hash_update + hash_query) / frames,
+               grid_update / frames, grid_query / frames, (grid_update + grid_query) / frames, grid.chunkCount());
+
+        if (hash_neighbours != grid_neighbours)
+        {
+            printf("  neighbour counts differ: hash %lld, grid %lld\n", hash_neighbours, grid_neighbours);
+            matches = false;
+        }
+    }
+
+    printf("(milliseconds per frame, averaged over %d frames, %d threads)\n", bench_frames, int(pool.size()) + 1);
+    return matches;
+}
+
+//Builds FlatKDTrees over 16 * 2^k - 1, 16 * 2^k and 16 * 2^k + 1 tanks, the counts where the leaves are just (not) full,
+//and checks their nearest neighbours against a brute force search
+static bool checkFlatKDTreeBuckets()
+{
+    mt19937 rng(16);
+    uniform_real_distribution<float> place(0, 1000);
+
+    int mismatches = 0;
+    for (int k = 0; k <= 8; k++)
+    {
+        for (const int count : {16 * (1 << k) - 1, 16 * (1 << k), 16 * (1 << k) + 1})
+        {
+            TankStore tanks;
+            tanks.reserve(count);
+            for (int i = 0; i < count; i++) tanks.add(place(rng), place(rng), BLUE, nullptr, 0, 0, 12, 1000, 1.5f);
+
+            FlatKDTree flat;
+            flat.build(tanks, 0, count);
+
+            for (int q = 0; q < 64; q++)
+            {
+                const vec2 query = {place(rng), place(rng)};
+                float closest = numeric_limits<float>::infinity();
+                for (int i = 0; i < count; i++) closest = min(closest, (tanks[i].Get_Position() - query).sqrLength());
+                if ((flat.findNearestNeighbour(query).Get_Position() - query).sqrLength() != closest) mismatches++;
+            }
+        }
+    }
+
+    if (mismatches > 0) printf("  flat tree differs from brute force for %d queries at leaf size boundaries\n", mismatches);
+    return mismatches == 0;
+}
+
+// -----------------------------------------------------------
+// Refit KDTree against the rebuilt FlatKDTree. Every frame the
+// tanks take a small random step and some die, then the tree is
+// brought up to date and answers one query per tank, one at a time.
+// The KDTree answers them with both of its traversals. First the
+// flat tree is checked at the counts where its leaves just fill up.
+// -----------------------------------------------------------
+static bool benchKDTree()
+{
+    printf("%10s %12s %12s %12s %12s %12s %12s\n", "tanks", "tree update", "recursive", "stack", "flat update", "flat query", "flat total");
+
+    bool matches = checkFlatKDTreeBuckets();
+    for (const int count : {2500, 25000, 250000})
+    {
+        const float scale = sqrtf(count / 2500.f);
+
+        mt19937 rng(count);
+        uniform_real_distribution<float> place_x(0, 1300 * scale), place_y(0, 1600 * scale), step(-1.5f, 1.5f);
+
+        TankStore tanks;
+        tanks.reserve(count);
+        for (int i = 0; i < count; i++) tanks.add(place_x(rng), place_y(rng), BLUE, nullptr, 0, 0, 12, 1000, 1.5f);
+
+        vector<vec2> queries(count);
+        for (auto& query : queries) query = {place_x(rng), place_y(rng)};
+
+        KDTree tree(tanks, 0, count);
+        FlatKDTree flat;
+
+        float tree_update = 0, recursive_query = 0, stack_query = 0, flat_update = 0, flat_query = 0;
+        int mismatches = 0;
+
+        for (int frame = 0; frame <= bench_frames; frame++)
+        {
+            //Roughly the game's rate of destruction, a tank in a few hundred dies per frame
+            for (int i = 0; i < count; i++)
+            {
+                tanks.position_x[i] += step(rng), tanks.position_y[i] += step(rng);
+                if (rng() % 400 == 0) tanks.active[i] = 0;
+            }
+
+            timer t;
+            tree.refit();
+            const float refit = t.elapsed();
+
+            const auto queryTree = [&](KDTree::Traversal traversal, float& sum) {
+                tree.setTraversal(traversal);
+                timer t;
+                sum = 0;
+                for (const vec2& query : queries) sum += (tree.findNearestNeighbour(query).Get_Position() - query).sqrLength();
+                return t.elapsed();
+            };
+
+            float recursive_sum, stack_sum;
+            const float recursive_queries = queryTree(KDTree::Traversal::Recursive, recursive_sum);
+            const float stack_queries = queryTree(KDTree::Traversal::Stack, stack_sum);
+
+            t.reset();
+            flat.build(tanks, 0, count);
+            const float build = t.elapsed();
+
+            t.reset();
+            float flat_sum = 0;
+            for (const vec2& query : queries) flat_sum += (flat.findNearestNeighbour(query).Get_Position() - query).sqrLength();
+            const float flat_queries = t.elapsed();
+
+            if (recursive_sum != flat_sum || stack_sum != flat_sum) mismatches++;
+            if (frame > 0) tree_update += refit, recursive_query += recursive_queries, stack_query += stack_queries, flat_update += build, flat_query += flat_queries;
+        }
+
+        const float frames = float(bench_frames);
+        printf("%10d %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f\n", count,
+               tree_update / frames, recursive_query / frames, stack_query / frames,
+               flat_update / frames, flat_query / frames, (flat_update + flat_query) / frames);
+
+        if (mismatches > 0)
+        {
+            printf("  nearest distances differ in %d frames\n", mismatches);
+            matches = false;
+        }
+    }
+
+    printf("(milliseconds per frame, averaged over %d frames)\n", bench_frames);
+    return matches;
+}
+
+// -----------------------------------------------------------
+// KD-trees against the TanksHasher as closest enemy engines.
+// Two armies either face each other across the battlefield, as the
+// game starts, or are mixed in one melee, as it ends. More tanks are
+// packed into the same area every run. Every frame the tanks take a
+// small random step, some die and one in twenty fires.
+// -----------------------------------------------------------
+static bool benchTargeting()
+{
+    ThreadPool pool{max(1u, thread::hardware_concurrency()) - 1};
+
+    printf("%10s %10s %12s %12s %12s %12s %12s %12s\n", "layout", "per team", "tree update", "tree query", "tree total", "hash update", "hash query", "hash total");
+
+    bool matches = true;
+    for (const bool melee : {false, true})
+    for (const int per_team : {100, 500, 1279, 5000, 20000})
+    {
+        const int count = 2 * per_team;
+
+        mt19937 rng(count);
+        uniform_real_distribution<float> place_x(0, melee ? 1300.f : 500.f), place_y(0, 1500), step(-1.5f, 1.5f);
+        const float red_x = melee ? 0.f : 800.f;
+
+        TankStore tanks;
+        tanks.reserve(count);
+        for (int i = 0; i < per_team; i++) tanks.add(place_x(rng), place_y(rng), BLUE, nullptr, 0, 0, 12, 1000, 1.5f);
+        for (int i = 0; i < per_team; i++) tanks.add(red_x + place_x(rng), place_y(rng), RED, nullptr, 0, 0, 12, 1000, 1.5f);
+
+        KDTree trees[2] = {KDTree(tanks, 0, per_team), KDTree(tanks, per_team, count)};
+        trees[0].setTraversal(KDTree::Traversal::Stack);
+        trees[1].setTraversal(KDTree::Traversal::Stack);
+
+        TanksHasher hasher({{-100, -100}, {1400, 1700}}, 25);
+        vector<vec2> hashed_positions(count);
+        vector<char> hashed(count, 0);
+
+        vector<int> shooters;
+        vector<vec2> positions;
+        vector<Tank> tree_targets, hash_targets;
+
+        float tree_update = 0, tree_query = 0, hash_update = 0, hash_query = 0;
+        int mismatches = 0;
+
+        for (int frame = 0; frame <= bench_frames; frame++)
+        {
+            shooters.clear();
+            for (int i = 0; i < count; i++)
+            {
+                tanks.position_x[i] += step(rng), tanks.position_y[i] += step(rng);
+                if (rng() % 400 == 0) tanks.active[i] = 0;
+                if (tanks.active[i] && rng() % 20 == 0) shooters.push_back(i);
+            }
+
+            timer t;
+            trees[0].refit();
+            trees[1].refit();
+            const float refit = t.elapsed();
+
+            t.reset();
+            tree_targets.assign(shooters.size(), Tank());
+            pool.parallel_for(0, int(shooters.size()), 16, [&](int start, int end) noexcept {
+                for (int j = start; j < end; j++)
+                {
+                    const Tank tank = tanks[shooters[j]];
+                    tree_targets[j] = trees[tank.Get_Allignment() == BLUE ? RED : BLUE].findNearestNeighbour(tank.Get_Position());
+                }
+            });
+            const float tree_queries = t.elapsed();
+
+            t.reset();
+            pool.parallel_for(0, count, 64, [&](int start, int end) noexcept {
+                for (int i = start; i < end; i++)
+                {
+                    const Tank tank = tanks[i];
+                    if (!tank.Is_Active())
+                    {
+                        if (hashed[i]) hasher.tryRemoveAt(hashed_positions[i], tank);
+                        hashed[i] = false;
+                        continue;
+                    }
+                    hashed[i] = hashed[i] ? hasher.tryUpdateAt(hashed_positions[i], tank.Get_Position(), tank) : hasher.tryInsertAt(tank.Get_Position(), tank);
+                    hashed_positions[i] = tank.Get_Position();
+                }
+            });
+            const float update = t.elapsed();
+
+            t.reset();
+            hash_targets.assign(shooters.size(), Tank());
+            pool.parallel_for(0, int(shooters.size()), 16, [&](int start, int end) noexcept {
+                for (int j = start; j < end; j++)
+                {
+                    const Tank tank = tanks[shooters[j]];
+                    hash_targets[j] = hasher.findClosestEnemy(tank.Get_Position(), tank.Get_Allignment());
+                }
+            });
+            const float hash_queries = t.elapsed();
+
+            for (size_t j = 0; j < shooters.size(); j++)
+            {
+                const vec2 position = tanks[shooters[j]].Get_Position();
+                if ((tree_targets[j].Get_Position() - position).sqrLength() != (hash_targets[j].Get_Position() - position).sqrLength()) mismatches++;
+            }
+
+            //The first frame inserts every tank into the hasher, only the incremental updates are timed
+            if (frame > 0) tree_update += refit, tree_query += tree_queries, hash_update += update, hash_query += hash_queries;
+        }
+
+        const float frames = float(bench_frames);
+        printf("%10s %10d %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f\n", melee ? "melee" : "apart", per_team,
+               tree_update / frames, tree_query / frames, (tree_update + tree_query) / frames,
+               hash_update / frames, hash_query / frames, (hash_update + hash_query) / frames);
+
+        if (mismatches > 0)
+        {
+            printf("  closest enemies differ for %d shots\n", mismatches);
+            matches = false;
+        }
+    }
+
+    printf("(milliseconds per frame, averaged over %d frames)\n", bench_frames);
+    return matches;
+}
+
+// -----------------------------------------------------------
+// Sweep and prune against one grid query per tank for finding the
+// overlapping pairs, at the game's density. Every frame all tanks
+// take a small random step before the pairs are counted.
+// -----------------------------------------------------------
+static bool benchSweep()
+{
+    ThreadPool pool{max(1u, thread::hardware_concurrency()) - 1};
+
+    printf("%10s %12s %12s %12s %12s %12s\n", "tanks", "grid update", "grid pairs", "grid total", "sweep sort", "sweep pairs");
+
+    bool matches = true;
+    for (const int count : {2500, 25000, 250000})
+    {
+        const float scale = sqrtf(count / 2500.f);
+        const BoundingBox world = {{-100, -100}, {-100 + 1500 * scale, -100 + 1800 * scale}};
+
+        mt19937 rng(count);
+        uniform_real_distribution<float> place_x(0, 1300 * scale), place_y(0, 1600 * scale), step(-1.5f, 1.5f);
+
+        vector<float> x(count), y(count);
+        for (int i = 0; i < count; i++) x[i] = place_x(rng), y[i] = place_y(rng);
+
+        UniformGrid<int> grid(world, bench_cell_size);
+        SweepAndPrune sweep(bench_query_radius);
+        vector<int> grid_found(count), sweep_found(count);
+
+        float grid_update = 0, grid_pairs = 0, sweep_sort = 0, sweep_pairs = 0;
+        int mismatches = 0;
+
+        for (int frame = 0; frame <= bench_frames; frame++)
+        {
+            for (int i = 0; i < count; i++) x[i] += step(rng), y[i] += step(rng);
+
+            timer t;
+            grid.rebuild(pool, count, [&](int i) noexcept { return UniformGrid<int>::Entry{vec2(x[i], y[i]), i}; });
+            const float rebuild = t.elapsed();
+
+            t.reset();
+            pool.parallel_for(0, count, bench_grain, [&](int start, int end) noexcept {
+                for (int i = start; i < end; i++)
+                {
+                    int pairs = 0;
+                    grid.forEachWithinBounds({vec2(x[i], y[i]), bench_query_radius}, [&](const UniformGrid<int>::Entry& entry) noexcept { if (entry.object != i) pairs++; });
+                    grid_found[i] = pairs;
+                }
+            });
+            const float grid_enumerate = t.elapsed();
+
+            t.reset();
+            sweep.update(x.data(), y.data(), count);
+            const float sort = t.elapsed();
+
+            //Counted for both objects of a pair, calls that run at once never share an object
+            t.reset();
+            fill(sweep_found.begin(), sweep_found.end(), 0);
+            sweep.forEachPair(pool, [&](int a, int b) noexcept { sweep_found[a]++, sweep_found[b]++; });
+            const float sweep_enumerate = t.elapsed();
+
+            //Every object has to have the same neighbours in both
+            if (grid_found != sweep_found) mismatches++;
+            if (frame > 0) grid_update += rebuild, grid_pairs += grid_enumerate, sweep_sort += sort, sweep_pairs += sweep_enumerate;
+        }
+
+        const float frames = float(bench_frames);
+        printf("%10d %12.3f %12.3f %12.3f %12.3f %12.3f\n", count,
+               grid_update / frames, grid_pairs / frames, (grid_update + grid_pairs) / frames,
+               sweep_sort / frames, sweep_pairs / frames);
+
+        if (mismatches > 0)
+        {
+            printf("  pair counts differ in %d frames\n", mismatches);
+            matches = false;
+        }
+    }
+
+    printf("(milliseconds per frame, averaged over %d frames)\n", bench_frames);
+    return matches;
+}
+
+//A sprite frame drawn at a spot on the screen
+struct SpriteDraw
+{
+    Sprite* sprite;
+    unsigned int frame;
+    int x, y;
+    unsigned int flags;
+};
+
+static vector<unique_ptr<Sprite>> loadGameSprites()
+{
+    vector<unique_ptr<Sprite>> sprites;
+    sprites.emplace_back(new Sprite(new Surface("assets/Tank_Proj2.png"), 12));
+    sprites.emplace_back(new Sprite(new Surface("assets/Rocket_Proj2.png"), 12));
+    sprites.emplace_back(new Sprite(new Surface("assets/Smoke.png"), 4));
+    sprites.emplace_back(new Sprite(new Surface("assets/Explosion.png"), 9));
+    sprites.emplace_back(new Sprite(new Surface("assets/Particle_Beam.png"), 3));
+    return sprites;
+}
+
+//Random frames of random 'sprites' at random, partly offscreen spots, one in 'flare_one_in' is a FLARE (0 for none)
+static vector<SpriteDraw> randomSpriteDraws(const vector<unique_ptr<Sprite>>& sprites, const int count, const int flare_one_in)
+{
+    mt19937 rng(count);
+    uniform_int_distribution<int> pick(0, int(sprites.size()) - 1), place_x(-50, SCRWIDTH + 50), place_y(-50, SCRHEIGHT + 50);
+
+    vector<SpriteDraw> draws(count);
+    for (auto& draw : draws)
+    {
+        Sprite* sprite = sprites[pick(rng)].get();
+        const unsigned int frame = uniform_int_distribution<unsigned int>(0, sprite->Frames() - 1)(rng);
+        const unsigned int flags = (flare_one_in > 0 && rng() % flare_one_in == 0) ? Sprite::FLARE : 0;
+        draw = {sprite, frame, place_x(rng), place_y(rng), flags};
+    }
+
+    return draws;
+}
+
+//Sprite::Draw as it was before spans and blitters: every pixel of the frame that is on the screen is tested for transparency
+static void drawPerPixel(Sprite& sprite, const unsigned int frame, Surface& target, const int x, const int y, const bool flare)
+{
+    const Pixel* src = sprite.GetBuffer() + frame * sprite.GetWidth();
+    const int pitch = sprite.GetSurface()->GetPitch();
+    for (int v = max(0, -y); v < min(sprite.GetHeight(), target.GetHeight() - y); v++)
+    {
+        for (int u = max(0, -x); u < min(sprite.GetWidth(), target.GetWidth() - x); u++)
+        {
+            const Pixel color = src[v * pitch + u];
+            if (!(color & 0xffffff)) continue;
+
+            Pixel& pixel = target.GetBuffer()[(y + v) * target.GetPitch() + x + u];
+            pixel = flare ? AddBlend(color, pixel) : color;
+        }
+    }
+}
+
+// -----------------------------------------------------------
+// Sprite::Draw with every blitter this CPU supports, copying and
+// adding (FLARE) the game's sprites onto the background at the
+// same random, partly offscreen spots. Every blitter has to leave
+// the exact same pixels as testing every pixel does.
+// -----------------------------------------------------------
+static bool benchBlit()
+{
+    const int draws = 20000;
+
+    const auto sprites = loadGameSprites();
+    const auto sequence = randomSpriteDraws(sprites, draws, 0);
+    Surface background("assets/Background_Grass.png");
+
+    //nullptr draws per pixel, the reference the others have to match
+    vector<const Blitter*> blitters = {nullptr, &scalar_blitter, &sse2_blitter};
+    if (cpuSupportsAVX2()) blitters.push_back(&avx2_blitter);
+    const Blitter& active = activeBlitter();
+
+    printf("%10s %12s %12s\n", "blitter", "opaque", "flare");
+
+    bool matches = true;
+    vector<Pixel> expected[2];
+    for (const Blitter* blitter : blitters)
+    {
+        if (blitter) setActiveBlitter(*blitter);
+        float milliseconds[2];
+        for (int mode = 0; mode < 2; mode++)
+        {
+            Surface target(SCRWIDTH, SCRHEIGHT);
+            background.CopyTo(&target, 0, 0);
+
+            timer t;
+            for (int frame = 0; frame < bench_frames; frame++)
+            {
+                for (const auto& draw : sequence)
+                {
+                    if (!blitter)
+                    {
+                        drawPerPixel(*draw.sprite, draw.frame, target, draw.x, draw.y, mode != 0);
+                        continue;
+                    }
+
+                    draw.sprite->Draw(&target, draw.x, draw.y, draw.frame, mode == 0 ? 0 : Sprite::FLARE);
+                }
+            }
+            milliseconds[mode] = t.elapsed() / bench_frames;
+
+            const vector<Pixel> pixels(target.GetBuffer(), target.GetBuffer() + SCRWIDTH * SCRHEIGHT);
+            if (!blitter)
+            {
+                expected[mode] = pixels;
+            }
+            else if (pixels != expected[mode])
+            {
+                printf("MISMATCH: %s %s differs from per pixel\n", blitter->name, mode == 0 ? "opaque" : "flare");
+                matches = false;
+            }
+        }
+
+        printf("%10s %12.3f %12.3f\n", blitter ? blitter->name : "per pixel", milliseconds[0], milliseconds[1]);
+    }
+    setActiveBlitter(active);
+
+    printf("(milliseconds per %d sprites, averaged over %d frames, opaque spans are copied whatever the blitter, flares use %s)\n", draws, bench_frames, active.name);
+    return matches;
+}
+
+// -----------------------------------------------------------
+// A frame of the background and random sprites, a quarter of them
+// FLAREs, drawn one after another on one thread against the
+// TileRenderer at several tile sizes. The tiles have to produce
+// the exact same pixels as drawing serially.
+// -----------------------------------------------------------
+static bool benchRender()
+{
+    ThreadPool pool{max(1u, thread::hardware_concurrency()) - 1};
+
+    const auto sprites = loadGameSprites();
+    Sprite background(new Surface("assets/Background_Grass.png"), 1);
+
+    printf("%10s %10s %12s %12s\n", "sprites", "tile size", "serial", "tiled");
+
+    bool matches = true;
+    for (const int count : {2000, 20000})
+    {
+        const auto draws = randomSpriteDraws(sprites, count, 4);
+
+        Surface expected(SCRWIDTH, SCRHEIGHT);
+        timer t;
+        for (int frame = 0; frame < bench_frames; frame++)
+        {
+            expected.Clear(0);
+            background.DrawClipped(&expected, 0, 0, 0, 0, 0, 0, SCRWIDTH, SCRHEIGHT);
+            for (const auto& draw : draws) draw.sprite->DrawClipped(&expected, draw.x, draw.y, draw.frame, draw.flags, 0, 0, SCRWIDTH, SCRHEIGHT);
+        }
+        const float serial = t.elapsed() / bench_frames;
+
+        for (const int tile_size : {64, 128, 256})
+        {
+            TileRenderer renderer(SCRWIDTH, SCRHEIGHT, tile_size);
+            Surface target(SCRWIDTH, SCRHEIGHT);
+
+            t.reset();
+            for (int frame = 0; frame < bench_frames; frame++)
+            {
+                renderer.begin(0);
+                renderer.submit(&background, 0, 0, 0);
+                for (const auto& draw : draws) renderer.submit(draw.sprite, draw.frame, draw.x, draw.y, draw.flags);
+                renderer.render(pool, &target);
+            }
+            const float tiled = t.elapsed() / bench_frames;
+
+            printf("%10d %10d %12.3f %12.3f\n", count, tile_size, serial, tiled);
+
+            if (memcmp(expected.GetBuffer(), target.GetBuffer(), sizeof(Pixel) * SCRWIDTH * SCRHEIGHT) != 0)
+            {
+                printf("MISMATCH: %d sprites in %d pixel tiles differ from drawing serially\n", count, tile_size);
+                matches = false;
+            }
+        }
+    }
+
+    printf("(milliseconds per frame, averaged over %d frames, %d threads)\n", bench_frames, int(pool.size()) + 1);
+    return matches;
+}
+
+// -----------------------------------------------------------
+// Random sprites that move a couple of pixels every frame, drawn
+// by a TileRenderer that clears the screen and draws the whole
+// background every frame against one that only restores what the
+// sprites drew over the frame before. Prints the bytes written to
+// the screen per frame, both have to produce the same pixels.
+// -----------------------------------------------------------
+static bool benchBackground()
+{
+    ThreadPool pool{max(1u, thread::hardware_concurrency()) - 1};
+
+    const auto sprites = loadGameSprites();
+    Sprite background(new Surface("assets/Background_Grass.png"), 1);
+    Surface background_cache(SCRWIDTH, SCRHEIGHT);
+    background_cache.Clear(0);
+    background.Draw(&background_cache, 0, 0, 0);
+
+    printf("%10s %14s %14s %12s %12s\n", "sprites", "full (KB)", "restore (KB)", "full", "restore");
+
+    bool matches = true;
+    for (const int count : {100, 1000, 2500, 10000})
+    {
+        auto draws = randomSpriteDraws(sprites, count, 4);
+        mt19937 rng(count);
+        uniform_int_distribution<int> step(-2, 2);
+
+        TileRenderer full(SCRWIDTH, SCRHEIGHT, 128), restore(SCRWIDTH, SCRHEIGHT, 128);
+        Surface full_target(SCRWIDTH, SCRHEIGHT), restore_target(SCRWIDTH, SCRHEIGHT);
+
+        long long full_bytes = 0, restore_bytes = 0;
+        float full_time = 0, restore_time = 0;
+        int mismatches = 0;
+        for (int frame = 0; frame < bench_frames; frame++)
+        {
+            for (auto& draw : draws)
+            {
+                draw.x += step(rng);
+                draw.y += step(rng);
+            }
+
+            timer t;
+            full.begin(0);
+            full.submit(&background, 0, 0, 0);
+            for (const auto& draw : draws) full.submit(draw.sprite, draw.frame, draw.x, draw.y, draw.flags);
+            full.render(pool, &full_target);
+            full_time += t.elapsed();
+
+            t.reset();
+            restore.beginRestore(&background_cache);
+            for (const auto& draw : draws) restore.submit(draw.sprite, draw.frame, draw.x, draw.y, draw.flags);
+            restore.render(pool, &restore_target);
+            restore_time += t.elapsed();
+
+            full_bytes += full.bytesWritten();
+            restore_bytes += restore.bytesWritten();
+            if (memcmp(full_target.GetBuffer(), restore_target.GetBuffer(), sizeof(Pixel) * SCRWIDTH * SCRHEIGHT) != 0) mismatches++;
+        }
+
+        printf("%10d %14.1f %14.1f %12.3f %12.3f\n", count, full_bytes / 1024.f / bench_frames, restore_bytes / 1024.f / bench_frames, full_time / bench_frames, restore_time / bench_frames);
+
+        if (mismatches > 0)
+        {
+            printf("MISMATCH: restoring differs from redrawing in %d frames\n", mismatches);
+            matches = false;
+        }
+    }
+
+    printf("(bytes written to the screen and milliseconds per frame, averaged over %d frames, %d threads)\n", bench_frames, int(pool.size()) + 1);
+    return matches;
+}
+
+// -----------------------------------------------------------
+// The whole game, headless, for every army size with 1, 2, 4 ..
+// up to one thread per hardware thread. Prints the median time
+// per phase, and the speedup and parallel efficiency over one
+// thread, so phases that stop scaling stand out. Given scenario
+// options, only that scenario is run, up to its thread count if
+// it sets one.
+// -----------------------------------------------------------
+static bool benchScaling(const Scenario* given)
+{
+    const int max_threads = (given && given->threads > 0) ? given->threads : max(1, int(thread::hardware_concurrency()));
+    vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    vector<Scenario> scenarios;
+    if (given) scenarios.push_back(*given);
+    else for (const int count : {1000, 10000, 100000, 1000000})
+    {
+        //Both armies spawn as squares, side by side in a world that fits them
+        Scenario scenario;
+        scenario.tanks_blue = count / 2;
+        scenario.tanks_red = count - count / 2;
+        scenario.max_frames = bench_frames;
+        scenario.spawn_columns = max(12, int(sqrtf(float(scenario.tanks_red))));
+        const float army_size = scenario.spawn_columns * scenario.spawn_spacing;
+        scenario.world = BoundingBox({-100, -100}, {max(1400.f, 2 * army_size + 1400), max(1700.f, army_size + 400)});
+        scenarios.push_back(scenario);
+    }
+
+    using Medians_T = array<float, Profiler::phase_count>;
+
+    Surface screen(SCRWIDTH, SCRHEIGHT);
+    for (Scenario scenario : scenarios)
+    {
+        const int count = scenario.tanks_blue + scenario.tanks_red;
+
+        vector<Medians_T> medians;
+        for (const int threads : thread_counts)
+        {
+            scenario.threads = threads;
+            auto game = make_unique<Game>(scenario);
+            game->SetTarget(&screen);
+            game->SetReport(false);
+            game->Init();
+            while (!game->Finished()) game->Tick(0);
+            game->Shutdown();
+
+            Medians_T phase_medians;
+            for (int p = 0; p < Profiler::phase_count; p++) phase_medians[p] = game->GetProfiler().calculateStats(Phase(p)).median;
+            medians.push_back(phase_medians);
+        }
+
+        const auto printTable = [&](const char* title, const auto& cell) {
+            printf("\n%d tanks, %s\n%-24s", count, title, "phase");
+            for (const int threads : thread_counts) printf(" %9dT", threads);
+            printf("\n");
+            for (int p = 0; p < Profiler::phase_count; p++)
+            {
+                printf("%-24s", Profiler::name(Phase(p)));
+                for (size_t t = 0; t < thread_counts.size(); t++) printf(" %10.2f", cell(p, t));
+                printf("\n");
+            }
+        };
+
+        //Phases that take no time on one thread have nothing to scale
+        const auto speedup = [&](int p, size_t t) { return medians[t][p] > 0 ? medians[0][p] / medians[t][p] : 1.f; };
+        printTable("median milliseconds per frame", [&](int p, size_t t) { return medians[t][p]; });
+        printTable("speedup over 1 thread", speedup);
+        printTable("parallel efficiency", [&](int p, size_t t) { return speedup(p, t) / thread_counts[t]; });
+    }
+
+    printf("\n(medians over %d frames per run)\n", scenarios.front().max_frames);
+    return true;
+}
+
+//True when 'scenario' differs from the defaults in its thread count only
+static bool onlySetsThreads(Scenario scenario)
+{
+    const Scenario defaults;
+    scenario.threads = defaults.threads;
+    return scenario.tanks_blue == defaults.tanks_blue && scenario.tanks_red == defaults.tanks_red && scenario.tank_max_health == defaults.tank_max_health
+        && scenario.max_frames == defaults.max_frames && scenario.world.min.x == defaults.world.min.x && scenario.world.min.y == defaults.world.min.y
+        && scenario.world.max.x == defaults.world.max.x && scenario.world.max.y == defaults.world.max.y && scenario.cell_size == defaults.cell_size
+        && scenario.spawn_spacing == defaults.spawn_spacing && scenario.spawn_columns == defaults.spawn_columns;
+}
+
+int runBenchmark(const char* name, const Scenario* scenario)
+{
+    const bool grid = strcmp(name, "grid") == 0;
+    if (scenario && strcmp(name, "scaling") != 0 && !(grid && onlySetsThreads(*scenario)))
+    {
+        printf("--bench %s doesn't take scenario options, only scaling does and grid takes --threads\n", name);
+        return 1;
+    }
+
+    if (grid) return benchGrid(scenario ? scenario->threads : 0) ? 0 : 1;
+    if (strcmp(name, "kdtree") == 0) return benchKDTree() ? 0 : 1;
+    if (strcmp(name, "targeting") == 0) return benchTargeting() ? 0 : 1;
+    if (strcmp(name, "sweep") == 0) return benchSweep() ? 0 : 1;
+    if (strcmp(name, "blit") == 0) return benchBlit() ? 0 : 1;
+    if (strcmp(name, "render") == 0) return benchRender() ? 0 : 1;
+    if (strcmp(name, "background") == 0) return benchBackground() ? 0 : 1;
+    if (strcmp(name, "scaling") == 0) return benchScaling(scenario) ? 0 : 1;
+
+    printf("unknown benchmark '%s', available: grid, kdtree, targeting, sweep, blit, render, background, scaling\n", name);
+    return 1;
+}
+
+} // namespace Tmpl8
@@ -0,0 +1,11 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Standalone micro benchmarks, selected with --bench <name> on the command line.
+//Returns the exit code for main, nonzero when 'name' is unknown or a benchmark failed its check.
+//'scenario' is null unless scenario options were given, only the scaling benchmark takes them and grid takes --threads
+int runBenchmark(const char* name, const Scenario* scenario);
+
+} // namespace Tmpl8
@@ -0,0 +1,97 @@
+#include "precomp.h" // include (only) this in every .cpp file
+
+//GCC and Clang only emit AVX2 for functions that ask for it, MSVC emits any intrinsic anywhere
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace Tmpl8
+{
+
+static void blitFlareScalar(Pixel* dest, const Pixel* src, const int count) noexcept
+{
+    for (int x = 0; x < count; x++)
+    {
+        const Pixel c1 = src[x];
+        if (c1 & 0xffffff) dest[x] = AddBlend(c1, dest[x]);
+    }
+}
+
+// Saturating byte adds are AddBlend for the color channels, AddBlend clears the top byte so the sum does too.
+// SSE2 has no cheap masked store, so the transparent lanes write back the pixel that was already there.
+static void blitFlareSSE2(Pixel* dest, const Pixel* src, const int count) noexcept
+{
+    const __m128i rgb = _mm_set1_epi32(0xffffff), zero = _mm_setzero_si128();
+
+    int x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        const __m128i color = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        const __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(color, rgb), zero);
+        if (_mm_movemask_epi8(transparent) == 0xffff) continue;
+
+        const __m128i target = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + x));
+        const __m128i sum = _mm_and_si128(_mm_adds_epu8(color, target), rgb);
+        const __m128i blended = _mm_or_si128(_mm_and_si128(transparent, target), _mm_andnot_si128(transparent, sum));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + x), blended);
+    }
+
+    blitFlareScalar(dest + x, src + x, count - x);
+}
+
+// Masked loads and stores handle the end of the row too, lanes past it are neither read nor written.
+TARGET_AVX2 static void blitFlareAVX2(Pixel* dest, const Pixel* src, const int count) noexcept
+{
+    const __m256i rgb = _mm256_set1_epi32(0xffffff), zero = _mm256_setzero_si256();
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (int x = 0; x < count; x += 8)
+    {
+        const __m256i inside = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - x), lanes);
+        const __m256i color = _mm256_maskload_epi32(reinterpret_cast<const int*>(src + x), inside);
+        const __m256i opaque = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(color, rgb), zero), inside);
+        if (_mm256_testz_si256(opaque, opaque)) continue;
+
+        const __m256i target = _mm256_maskload_epi32(reinterpret_cast<const int*>(dest + x), opaque);
+        const __m256i sum = _mm256_and_si256(_mm256_adds_epu8(color, target), rgb);
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(dest + x), opaque, sum);
+    }
+}
+
+const Blitter scalar_blitter = {"scalar", blitFlareScalar};
+const Blitter sse2_blitter = {"sse2", blitFlareSSE2};
+const Blitter avx2_blitter = {"avx2", blitFlareAVX2};
+
+bool cpuSupportsAVX2() noexcept
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    // The OS has to save the upper halves of the registers on a context switch as well.
+    __cpuid(info, 1);
+    const bool os_saves_avx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+
+    __cpuidex(info, 7, 0);
+    return os_saves_avx && (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static const Blitter* active_blitter = cpuSupportsAVX2() ? &avx2_blitter : &sse2_blitter;
+
+const Blitter& activeBlitter() noexcept
+{
+    return *active_blitter;
+}
+
+void setActiveBlitter(const Blitter& blitter) noexcept
+{
+    active_blitter = &blitter;
+}
+
+} // namespace Tmpl8
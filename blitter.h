@@ -0,0 +1,25 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Row blitters behind Sprite::Draw: 'count' pixels from 'src' onto 'dest', skipping source pixels that are black.
+//'flare' adds the source to the target with every channel saturated, like AddBlend. Opaque spans are plain copies and need no blitter.
+//All instruction sets write exactly the pixels the scalar one writes, and never touch pixels outside of the row
+struct Blitter
+{
+    const char* name;
+    void (*flare)(Pixel* dest, const Pixel* src, int count) noexcept;
+};
+
+extern const Blitter scalar_blitter;
+extern const Blitter sse2_blitter;
+extern const Blitter avx2_blitter;
+
+bool cpuSupportsAVX2() noexcept;
+
+//Blitter used by Sprite::Draw, AVX2 when the CPU supports it and SSE2 otherwise
+const Blitter& activeBlitter() noexcept;
+void setActiveBlitter(const Blitter& blitter) noexcept;
+
+} // namespace Tmpl8
@@ -0,0 +1,175 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Collects entities spawned from the threads of a ThreadPool without locking, every thread appends to its own buffer.
+//The buffered entities are moved into an EntityPool once the phase that spawned them is done, see EntityPool::spawn
+template <typename T>
+class SpawnBuffer
+{
+
+public:
+
+    explicit SpawnBuffer(const ThreadPool& pool) : pool(pool), buffers(pool.size() + 2) {}
+    SpawnBuffer(const SpawnBuffer& other) = delete;
+    SpawnBuffer& operator=(const SpawnBuffer& other) = delete;
+
+    void push(const T& entity) noexcept;
+
+    template <typename Callable_T>
+    void drain(const Callable_T& callable) noexcept;
+
+private:
+
+    //Padded so the buffers of different threads don't share a cache line
+    struct Buffer
+    {
+        std::vector<T> entities;
+        char padding[64 - sizeof(std::vector<T>) % 64];
+    };
+
+    const ThreadPool& pool;
+
+    //One per worker and one for the owner of the pool, the last one is shared by any other thread
+    std::vector<Buffer> buffers;
+    std::mutex foreign_mutex;
+
+};
+
+template <typename T>
+inline void SpawnBuffer<T>::push(const T& entity) noexcept
+{
+    const int index = pool.threadIndex();
+    if (index < 0)
+    {
+        std::unique_lock<std::mutex> lock(foreign_mutex);
+        buffers.back().entities.push_back(entity);
+        return;
+    }
+
+    buffers[index].entities.push_back(entity);
+}
+
+template <typename T>
+template <typename Callable_T>
+inline void SpawnBuffer<T>::drain(const Callable_T& callable) noexcept
+{
+    for (auto& buffer : buffers)
+    {
+        for (const auto& entity : buffer.entities)
+        {
+            callable(entity);
+        }
+
+        // Clearing keeps the capacity, so a warmed up buffer doesn't allocate anymore.
+        buffer.entities.clear();
+    }
+}
+
+//Slot storage for short lived entities. Dead slots go on a free list and are reused by later spawns,
+//so spawning and killing are O(1) and never move the other entities around.
+//Storage only grows when more entities are alive at once than were reserved.
+template <typename T>
+class EntityPool
+{
+
+public:
+
+    EntityPool() noexcept = default;
+
+    void reserve(int capacity);
+
+    int spawn(const T& entity) noexcept;
+    void spawn(SpawnBuffer<T>& spawns) noexcept;
+    void kill(int slot) noexcept;
+
+    template <typename Predicate_T>
+    void killIf(const Predicate_T& predicate) noexcept;
+
+    template <typename Callable_T>
+    void forEach(const Callable_T& callable) noexcept;
+
+    bool isAlive(int slot) const noexcept { return alive[slot] != 0; }
+    T& operator[](int slot) noexcept { return slots[slot]; }
+
+    //Number of living entities
+    int size() const noexcept { return alive_count; }
+
+    //Highest slot ever used plus one, iterate [0, slotCount()) and skip the slots that aren't alive
+    int slotCount() const noexcept { return int(slots.size()); }
+
+private:
+
+    std::vector<T> slots;
+    std::vector<char> alive;
+    std::vector<int> free_slots;
+    int alive_count = 0;
+
+};
+
+template <typename T>
+inline void EntityPool<T>::reserve(int capacity)
+{
+    slots.reserve(capacity);
+    alive.reserve(capacity);
+    free_slots.reserve(capacity);
+}
+
+template <typename T>
+inline int EntityPool<T>::spawn(const T& entity) noexcept
+{
+    alive_count++;
+
+    if (free_slots.empty())
+    {
+        slots.push_back(entity);
+        alive.push_back(1);
+        return int(slots.size()) - 1;
+    }
+
+    const int slot = free_slots.back();
+    free_slots.pop_back();
+
+    slots[slot] = entity;
+    alive[slot] = 1;
+    return slot;
+}
+
+template <typename T>
+inline void EntityPool<T>::spawn(SpawnBuffer<T>& spawns) noexcept
+{
+    spawns.drain([this](const T& entity) noexcept { spawn(entity); });
+}
+
+template <typename T>
+inline void EntityPool<T>::kill(const int slot) noexcept
+{
+    assert(isAlive(slot) && "Killing an entity that is already dead!");
+
+    alive[slot] = 0;
+    free_slots.push_back(slot);
+    alive_count--;
+}
+
+template <typename T>
+template <typename Predicate_T>
+inline void EntityPool<T>::killIf(const Predicate_T& predicate) noexcept
+{
+    for (int slot = 0; slot < slotCount(); slot++)
+    {
+        if (alive[slot] && predicate(slots[slot])) kill(slot);
+    }
+}
+
+template <typename T>
+template <typename Callable_T>
+inline void EntityPool<T>::forEach(const Callable_T& callable) noexcept
+{
+    for (int slot = 0; slot < slotCount(); slot++)
+    {
+        if (alive[slot]) callable(slots[slot]);
+    }
+}
+
+} // namespace Tmpl8
@@ -11,8 +11,7 @@ void Tmpl8::Explosion::Tick()
     if (current_frame < 18) current_frame++;
 }
 
-void Tmpl8::Explosion::Draw(Surface* screen)
+void Tmpl8::Explosion::Draw(TileRenderer& renderer) const
 {
-    explosion_sprite->SetFrame(current_frame / 2);
-    explosion_sprite->Draw(screen, (int)position.x, (int)position.y);
+    renderer.submit(explosion_sprite, current_frame / 2, (int)position.x, (int)position.y);
 }
@@ -10,7 +10,7 @@ class Explosion
 
     bool done() const;
     void Tick();
-    void Draw(Surface* screen);
+    void Draw(TileRenderer& renderer) const;
 
     vec2 position;
 
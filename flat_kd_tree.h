@@ -0,0 +1,180 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Pointer free KD-tree that is rebuilt from scratch instead of refit.
+//Interior nodes are stored implicitly as a complete binary tree, the children of node i are 2i+1 and 2i+2,
+//and only hold their split plane. The leaves at the bottom level hold copies of the positions and the store index
+//of their tanks in structure of arrays buckets, so a query never reads from the TankStore until it returns its result
+class FlatKDTree final
+{
+
+public:
+
+    FlatKDTree() noexcept = default;
+    FlatKDTree(const FlatKDTree& other) noexcept = delete;
+    FlatKDTree(FlatKDTree&& other) noexcept = default;
+
+    FlatKDTree& operator=(const FlatKDTree& tree) noexcept = delete;
+    FlatKDTree& operator=(FlatKDTree&& tree) noexcept = default;
+
+    //Builds the tree over the active tanks in [begin, end) of 'tanks'
+    void build(TankStore& tanks, int begin, int end) noexcept;
+
+    Tank findNearestNeighbour(vec2 point) const noexcept;
+
+    //Same contract as KDTree::findNearestNeighbours
+    void findNearestNeighbours(ThreadPool& pool, span<const vec2> queries, span<Tank> out) const noexcept;
+
+    //Number of tanks in the tree
+    int size() const noexcept { return int(points.size()); }
+
+    ~FlatKDTree() noexcept = default;
+
+private:
+
+    struct Node
+    {
+        float split;
+        int axis;
+    };
+
+    struct Point
+    {
+        vec2 position;
+        int index;
+    };
+
+    static constexpr int bucket_size = 16;
+    static_assert(bucket_size % 8 == 0, "Buckets are searched a whole SIMD vector at a time!");
+    static constexpr int query_grain = 32;
+
+    TankStore* store = nullptr;
+    int depth = 0; //Levels of interior nodes, the leaves are the 2^depth nodes below them
+
+    std::vector<Node> nodes;
+    std::vector<float> bucket_x;
+    std::vector<float> bucket_y;
+    std::vector<int> bucket_index;
+    std::vector<int> bucket_count;
+
+    std::vector<Point> points; //Build workspace
+
+    void build(int node, int level, int begin, int end) noexcept;
+    void findNearestNeighbour(const vec2& point, int node, int level, int& closest_index, float& closest_distance) const noexcept;
+};
+
+inline void FlatKDTree::build(TankStore& tanks, int begin, int end) noexcept
+{
+    this->store = &tanks;
+
+    this->points.clear();
+    for (int i = begin; i < end; i++)
+    {
+        if (tanks.active[i]) this->points.push_back(Point{vec2(tanks.position_x[i], tanks.position_y[i]), i});
+    }
+
+    // Just deep enough that the largest leaf, which gets the rounded up half at every split, fits in a bucket.
+    this->depth = 0;
+    while (((int(points.size()) + (1 << depth) - 1) >> depth) > bucket_size) depth++;
+
+    const int leaves = 1 << depth;
+    this->nodes.resize(leaves - 1);
+    this->bucket_x.assign(size_t(leaves) * bucket_size, std::numeric_limits<float>::infinity());
+    this->bucket_y.assign(size_t(leaves) * bucket_size, std::numeric_limits<float>::infinity());
+    this->bucket_index.assign(size_t(leaves) * bucket_size, -1);
+    this->bucket_count.assign(leaves, 0);
+
+    build(0, 0, 0, int(points.size()));
+}
+
+inline void FlatKDTree::build(const int node, const int level, const int begin, const int end) noexcept
+{
+    if (level == depth)
+    {
+        const int leaf = node - ((1 << depth) - 1);
+        const int first = leaf * bucket_size;
+        for (int i = begin; i < end; i++)
+        {
+            bucket_x[first + i - begin] = points[i].position.x;
+            bucket_y[first + i - begin] = points[i].position.y;
+            bucket_index[first + i - begin] = points[i].index;
+        }
+        bucket_count[leaf] = end - begin;
+        return;
+    }
+
+    // Split along the longest side of the range.
+    vec2 min = points[begin].position, max = points[begin].position;
+    for (int i = begin + 1; i < end; i++)
+    {
+        min = {std::min(min.x, points[i].position.x), std::min(min.y, points[i].position.y)};
+        max = {std::max(max.x, points[i].position.x), std::max(max.y, points[i].position.y)};
+    }
+    const int axis = (max.x - min.x) >= (max.y - min.y) ? 0 : 1;
+    const int middle = begin + (end - begin) / 2;
+
+    { // Partially sort 'points' such that the object pointed to by middle_it appears at the same index as if 'points' had been fully sorted.
+        const auto comparator = [=](const Point& a, const Point& b) noexcept { return a.position.cell[axis] < b.position.cell[axis]; };
+        std::nth_element(this->points.begin() + begin, this->points.begin() + middle, this->points.begin() + end, comparator);
+    } // Done sorting
+
+    nodes[node] = Node{points[middle].position.cell[axis], axis};
+    build(2 * node + 1, level + 1, begin, middle);
+    build(2 * node + 2, level + 1, middle, end);
+}
+
+inline Tank FlatKDTree::findNearestNeighbour(vec2 point) const noexcept
+{
+    int closest_index = -1;
+    float closest_distance = std::numeric_limits<float>::infinity();
+    findNearestNeighbour(point, 0, 0, closest_index, closest_distance);
+
+    return closest_index < 0 ? Tank() : Tank(store, closest_index);
+}
+
+inline void FlatKDTree::findNearestNeighbours(ThreadPool& pool, span<const vec2> queries, span<Tank> out) const noexcept
+{
+    assert(queries.size() == out.size() && "Every query needs an output!");
+
+    pool.parallel_for(0, queries.size(), query_grain, [&](int start, int end) noexcept
+    {
+        for (int i = start; i < end; i++)
+        {
+            int closest_index = -1;
+            float closest_distance = std::numeric_limits<float>::infinity();
+
+            const Tank hint = out[i];
+            if (hint.store == store && hint.store != nullptr && hint.Is_Active())
+            {
+                closest_index = hint.index;
+                closest_distance = (hint.Get_Position() - queries[i]).sqrLength();
+            }
+
+            findNearestNeighbour(queries[i], 0, 0, closest_index, closest_distance);
+            out[i] = closest_index < 0 ? Tank() : Tank(store, closest_index);
+        }
+    });
+}
+
+inline void FlatKDTree::findNearestNeighbour(const vec2& point, const int node, const int level, int& closest_index, float& closest_distance) const noexcept
+{
+    if (level == depth)
+    {
+        const int leaf = node - ((1 << depth) - 1);
+        const int first = leaf * bucket_size;
+        const int slot = searchBucketSlots(&bucket_x[first], &bucket_y[first], bucket_count[leaf], point, closest_distance);
+        if (slot >= 0) closest_index = bucket_index[first + slot];
+        return;
+    }
+
+    // The left child holds the positions at or before the split, the right child those at or after it.
+    const Node& current_node = nodes[node];
+    const float d = point.cell[current_node.axis] - current_node.split;
+    findNearestNeighbour(point, d < 0 ? 2 * node + 1 : 2 * node + 2, level + 1, closest_index, closest_distance);
+    if (d * d < closest_distance)
+        findNearestNeighbour(point, d < 0 ? 2 * node + 2 : 2 * node + 1, level + 1, closest_index, closest_distance);
+}
+
+} // namespace Tmpl8
@@ -1,12 +1,11 @@
 #include "precomp.h" // include (only) this in every .cpp file
 
-#define NUM_TANKS_BLUE 1279
-#define NUM_TANKS_RED 1279
-
-#define TANK_MAX_HEALTH 1000
 #define ROCKET_HIT_VALUE 60
 #define PARTICLE_BEAM_HIT_VALUE 50
 
+//Rockets expire after this many frames, or as soon as they leave the world of tanks_grid
+#define ROCKET_MAX_AGE 800
+
 #define TANK_MAX_SPEED 1.5
 
 #define HEALTH_BARS_OFFSET_X 0
@@ -14,7 +13,9 @@
 #define HEALTH_BAR_WIDTH 1
 #define HEALTH_BAR_SPACING 0
 
-#define MAX_FRAMES 2000
+//Per-phase timings are written to these files once the last frame of the scenario is reached
+#define PROFILE_FRAMES_FILE "profile_frames.csv"
+#define PROFILE_SUMMARY_FILE "profile_summary.json"
 
 //Global performance timer
 #define REF_PERFORMANCE 11871.4 //UPDATE THIS WITH YOUR REFERENCE PERFORMANCE (see console after 2k frames)
@@ -49,7 +50,33 @@ const static float rocket_radius = 10.f;
 const static float tank_vs_tank_radius   = ceil(sqrt(2 * tank_radius * tank_radius));
 const static float tank_vs_rocket_radius = ceil(sqrt(2 * (tank_radius+rocket_radius) * (tank_radius+rocket_radius)));
 
-const unsigned int Game::thread_count = thread::hardware_concurrency();
+//Number of consecutive items a thread claims at once in the parallel passes
+const static int tanks_grain = 64;
+const static int rockets_grain = 32;
+const static int health_bars_grain = 256;
+const static int targets_grain = 16;
+
+
+//State shared between the phases of a frame, the frame graph uses these to find phases that may overlap
+enum FrameResource : ResourceSet
+{
+    TANK_LIST = 1 << 0,   //Order of the tanks vector, the health bar sort reorders it
+    TANK_MOTION = 1 << 1, //Positions, forces, sprite frames and the tanks hash
+    TANK_RELOAD = 1 << 2,
+    TANK_HEALTH = 1 << 3, //Health and active flags
+    KD_TREES = 1 << 4,
+    ROCKETS = 1 << 5,
+    SMOKES = 1 << 6,
+    EXPLOSIONS = 1 << 7,
+    PARTICLE_BEAMS = 1 << 8,
+    BACKGROUND = 1 << 9,  //Background buffer, tanks draw their tread marks into it
+    SCREEN = 1 << 10,
+    SNAPSHOT = 1 << 11    //Render snapshot captured this frame
+};
+
+Game::Game(const Scenario& scenario) : scenario(scenario), thread_count(scenario.threads > 0 ? scenario.threads : max(1u, thread::hardware_concurrency()))
+{
+}
 
 // -----------------------------------------------------------
 // Initialize the application
@@ -58,42 +85,63 @@ void Game::Init()
 {
     frame_count_font = new Font("assets/digital_small.png", "ABCDEFGHIJKLMNOPQRSTUVWXYZ:?!=-0123456789.");
 
-    tanks.reserve(NUM_TANKS_BLUE + NUM_TANKS_RED);
+    background_cache.Clear(0);
+    background.Draw(&background_cache, 0, 0, 0);
+
+    const int tanks_total = scenario.tanks_blue + scenario.tanks_red;
+    tanks.reserve(tanks_total);
     rockets.reserve(5000);
+    smokes.reserve(tanks_total);
+    explosions.reserve(500);
     particle_beams.reserve(3);
 
-    uint rows = (uint)sqrt(NUM_TANKS_BLUE + NUM_TANKS_RED);
-    uint max_rows = 12;
+    int max_rows = scenario.spawn_columns;
 
     float start_blue_x = tank_size.x + 10.0f;
     float start_blue_y = tank_size.y + 80.0f;
 
-    float start_red_x = 980.0f;
+    //Large armies spawn in wider blocks, the red one starts right of the blue one so they never overlap
+    float start_red_x = max(980.0f, start_blue_x + max_rows * scenario.spawn_spacing + 100.0f);
     float start_red_y = 100.0f;
 
-    float spacing = 15.0f;
+    float spacing = scenario.spawn_spacing;
 
     //Spawn blue tanks
-    for (int i = 0; i < NUM_TANKS_BLUE; i++)
+    for (int i = 0; i < scenario.tanks_blue; i++)
     {
-        Tank* tank = new Tank(start_blue_x + ((i % max_rows) * spacing), start_blue_y + ((i / max_rows) * spacing), BLUE, &tank_blue, &smoke, 1200, 600, tank_radius, TANK_MAX_HEALTH, TANK_MAX_SPEED);
-        tanks.push_back(tank);
-        tanks_hash.tryInsertAt(tank->Get_Position(), tank);
+        tanks.add(start_blue_x + ((i % max_rows) * spacing), start_blue_y + ((i / max_rows) * spacing), BLUE, &tank_blue, 1200, 600, tank_radius, scenario.tank_max_health, TANK_MAX_SPEED);
     }
     //Spawn red tanks
-    for (int i = 0; i < NUM_TANKS_RED; i++)
+    for (int i = 0; i < scenario.tanks_red; i++)
     {
-        Tank* tank = new Tank(start_red_x + ((i % max_rows) * spacing), start_red_y + ((i / max_rows) * spacing), RED, &tank_red, &smoke, 80, 80, tank_radius, TANK_MAX_HEALTH, TANK_MAX_SPEED);
-        tanks.push_back(tank);
-        tanks_hash.tryInsertAt(tank->Get_Position(), tank);
+        tanks.add(start_red_x + ((i % max_rows) * spacing), start_red_y + ((i / max_rows) * spacing), RED, &tank_red, 80, 80, tank_radius, scenario.tank_max_health, TANK_MAX_SPEED);
     }
 
-    blue_tree = KDTree(tanks, 0, NUM_TANKS_BLUE);
-    red_tree = KDTree(tanks, NUM_TANKS_BLUE, NUM_TANKS_BLUE + NUM_TANKS_RED);
+    RebuildTanksGrid();
+    tanks_sweep = SweepAndPrune(tank_vs_tank_radius);
+
+    blue_tree = KDTree(tanks, 0, scenario.tanks_blue);
+    red_tree = KDTree(tanks, scenario.tanks_blue, tanks_total);
+    //Measured faster than the recursive traversal, see --bench kdtree
+    blue_tree.setTraversal(KDTree::Traversal::Stack);
+    red_tree.setTraversal(KDTree::Traversal::Stack);
+    last_targets.resize(tanks.size());
+    hashed_positions.resize(tanks.size());
+    hashed.resize(tanks.size(), 0);
+
+    //The workers of the pool are running by now, so the counters see every thread
+    profiler.enableCacheCounters();
 
     particle_beams.push_back(Particle_beam(vec2(SCRWIDTH / 2, SCRHEIGHT / 2), vec2(100, 50), &particle_beam_sprite, PARTICLE_BEAM_HIT_VALUE));
     particle_beams.push_back(Particle_beam(vec2(80, 80), vec2(100, 50), &particle_beam_sprite, PARTICLE_BEAM_HIT_VALUE));
     particle_beams.push_back(Particle_beam(vec2(1200, 600), vec2(100, 50), &particle_beam_sprite, PARTICLE_BEAM_HIT_VALUE));
+
+    //Draw has to find the starting positions in its snapshot on the first frame
+    if (lockstep) drawn_snapshot = captured_snapshot;
+    CaptureSnapshot();
+    if (!lockstep) std::swap(captured_snapshot, drawn_snapshot);
+
+    BuildFrameGraph();
 }
 
 // -----------------------------------------------------------
@@ -106,16 +154,16 @@ void Game::Shutdown()
 // -----------------------------------------------------------
 // Iterates through all tanks and returns the closest enemy tank for the given tank
 // -----------------------------------------------------------
-Tank* Game::FindClosestEnemy(Tank* current_tank)
+Tank Game::FindClosestEnemy(Tank current_tank)
 {
     float closest_distance = numeric_limits<float>::infinity();
     int closest_index = 0;
 
     for (int i = 0; i < tanks.size(); i++)
     {
-        if (tanks.at(i)->allignment != current_tank->allignment && tanks.at(i)->active)
+        if (tanks[i].Get_Allignment() != current_tank.Get_Allignment() && tanks[i].Is_Active())
         {
-            float sqrDist = fabsf((tanks.at(i)->Get_Position() - current_tank->Get_Position()).sqrLength());
+            float sqrDist = fabsf((tanks[i].Get_Position() - current_tank.Get_Position()).sqrLength());
             if (sqrDist < closest_distance)
             {
                 closest_distance = sqrDist;
@@ -124,126 +172,267 @@ Tank* Game::FindClosestEnemy(Tank* current_tank)
         }
     }
 
-    return tanks.at(closest_index);
+    return tanks[closest_index];
 }
 
-template <typename Callable_T>
-void Game::RunParallel(const Callable_T& callable, const int N, const unsigned int max_threads) noexcept
+//Draws the snapshot captured by the last frame (the one before it unless running in lockstep)
+void Game::Draw()
 {
-    if (N >= max_threads)
-    {
-        std::atomic<int> jobs_running = 0;
+    DrawBackground();
+    DrawTanks();
+    DrawRockets();
+    DrawSmokes();
+    DrawParticleBeams();
+    DrawExplosions();
+    Rasterize();
+    DrawHealthBars();
+}
 
-        for (auto i = 0; i < max_threads; i++)
-        {
-            if (i < (max_threads - 1))
-            {
-                jobs_running++;
-                pool.enqueue([&, i]() noexcept -> void
-                             {
-                                 callable(float(N) / max_threads * i, float(N) / max_threads * (i + 1));
-                                 jobs_running--;
-                             });
-            }
-            else
-            {
-                callable(float(N) / max_threads * i, float(N) / max_threads * (i + 1));
-                while (jobs_running) /*wait for all jobs to finish*/
-                    ;
-            }
-        }
+// -----------------------------------------------------------
+// Declare the phases of Update and Draw in program order with the
+// state they touch, phases that don't conflict run concurrently.
+// Draw only reads the render snapshot, when pipelined that is the
+// one captured last frame so drawing overlaps the whole Update.
+// -----------------------------------------------------------
+void Game::BuildFrameGraph()
+{
+    const ResourceSet drawn = lockstep ? ResourceSet(SNAPSHOT) : ResourceSet(0);
+
+    frame_graph.add(0, TANK_LIST | TANK_MOTION | TANK_RELOAD | TANK_HEALTH | KD_TREES, [this]() { ReorderTanks(); });
+    frame_graph.add(TANK_LIST | TANK_HEALTH, TANK_MOTION | TANK_RELOAD, [this]() { UpdateTanks(); });
+    frame_graph.add(TANK_LIST | TANK_MOTION | TANK_HEALTH, TANK_RELOAD | KD_TREES | ROCKETS, [this]() { FireRockets(); });
+    frame_graph.add(0, SMOKES, [this]() { UpdateSmokes(); });
+    frame_graph.add(TANK_MOTION, ROCKETS | TANK_HEALTH | EXPLOSIONS | SMOKES, [this]() { UpdateRockets(); });
+    frame_graph.add(TANK_MOTION, PARTICLE_BEAMS | TANK_HEALTH | SMOKES, [this]() { UpdateParticleBeams(); });
+    frame_graph.add(0, EXPLOSIONS, [this]() { UpdateExplosions(); });
+    frame_graph.add(TANK_LIST | TANK_MOTION | TANK_HEALTH | ROCKETS | SMOKES | EXPLOSIONS | PARTICLE_BEAMS, SNAPSHOT, [this]() { CaptureSnapshot(); });
+
+    //The sprite phases only record draws, Rasterize draws them all at once
+    frame_graph.add(0, SCREEN, [this]() { DrawBackground(); });
+    frame_graph.add(drawn, SCREEN, [this]() { DrawTanks(); });
+    frame_graph.add(drawn, SCREEN, [this]() { DrawRockets(); });
+    frame_graph.add(drawn, SCREEN, [this]() { DrawSmokes(); });
+    frame_graph.add(drawn, SCREEN, [this]() { DrawParticleBeams(); });
+    frame_graph.add(drawn, SCREEN, [this]() { DrawExplosions(); });
+    frame_graph.add(drawn, SCREEN | BACKGROUND, [this]() { Rasterize(); });
+    frame_graph.add(drawn, SCREEN, [this]() { DrawHealthBars(); });
+}
+
+//Moves element order[i] to index i, like TankStore::reorder
+template <typename T>
+static void permute(vector<T>& values, const vector<int>& order)
+{
+    vector<T> permuted(values.size());
+    for (size_t i = 0; i < values.size(); i++) permuted[i] = values[order[i]];
+    values.swap(permuted);
+}
+
+//Tanks keep moving away from where they spawned, so every reorder_interval frames they are sorted along a Z-order curve
+//to keep tanks that are close in the world close in memory. Everything that refers to a tank by index is remapped
+void Game::ReorderTanks()
+{
+    if (reorder_interval <= 0 || frame_count % reorder_interval != 0) return;
+
+    ProfileZone zone(profiler, Phase::ReorderTanks);
+    const int count = tanks.size();
+    const auto& world = tanks_grid.getBoundary();
+
+    morton_codes.resize(count);
+    tank_order.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        morton_codes[i] = mortonCode(tanks[i].Get_Position(), world);
+        tank_order[i] = i;
     }
-    else
+    radixSort(morton_codes, tank_order, morton_scratch, order_scratch);
+
+    tanks.reorder(tank_order.data());
+
+    new_index.resize(count);
+    for (int i = 0; i < count; i++) new_index[tank_order[i]] = i;
+
+    blue_tree.remap(new_index);
+    red_tree.remap(new_index);
+    tanks_hasher.remap(new_index);
+    tanks_sweep.remap(new_index);
+
+    permute(last_targets, tank_order);
+    for (Tank& target : last_targets)
     {
-        callable(0, N);
+        if (target.index >= 0) target.index = new_index[target.index];
     }
+    permute(hashed_positions, tank_order);
+    permute(hashed, tank_order);
+
+    RebuildTanksGrid();
 }
 
-// -----------------------------------------------------------
-// Update the game state:
-// Move all objects
-// Update sprite frames
-// Collision detection
-// Targeting etc..
-// -----------------------------------------------------------
-void Game::Update(float deltaTime)
+//Tanks push each other apart first, so every tank sees the positions of the last frame,
+//then they are moved by the SIMD kernel in TankStore::tick and the grid is rebuilt
+void Game::UpdateTanks()
 {
-    auto updateTanks = [&](int start, int end) noexcept
+    ProfileZone zone(profiler, Phase::UpdateTanks);
+
+    //Every overlapping pair is found once and both tanks are pushed away from each other, destroyed tanks still block but don't move
+    auto pushApart = [&](int a, int b) noexcept
     {
-        for (auto i = start; i < end; i++)
+        const auto tank = tanks[a], other = tanks[b];
+        if (!tank.Is_Active() && !other.Is_Active()) return;
+
+        vec2 dir = tank.Get_Position() - other.Get_Position();
+        float dirSquaredLen = dir.sqrLength();
+        float colSquaredLen = (tank.Get_collision_radius() * tank.Get_collision_radius()) + (other.Get_collision_radius() * other.Get_collision_radius());
+
+        if (dirSquaredLen < colSquaredLen)
         {
-            auto tank = tanks[i];
-            if (tank->active)
-            {
-                tanks_hash.forEachWithinBounds({tank->position, tank_vs_tank_radius}, [&](const SpatialHasher<Tank*>::Entry& oTank) noexcept
-                {
-                    if (tank == oTank.object) return;
-                    
-                    vec2 dir = tank->Get_Position() - oTank.object->Get_Position();
-                    float dirSquaredLen = dir.sqrLength();
+            const vec2 push = dir.normalized();
+            if (tank.Is_Active()) tank.Push(push, 1.f);
+            if (other.Is_Active()) other.Push(-push, 1.f);
+        }
+    };
 
-                    float colSquaredLen = (tank->Get_collision_radius() * tank->Get_collision_radius()) + (oTank.object->Get_collision_radius() * oTank.object->Get_collision_radius());
+    tanks_sweep.update(tanks.position_x, tanks.position_y, tanks.size());
+    tanks_sweep.forEachPair(pool, pushApart);
 
-                    if (dirSquaredLen < colSquaredLen)
-                    {
-                        tank->Push(dir.normalized(), 1.f);
-                    }
-                });
+    pool.parallel_for(0, tanks.size(), tanks_grain, [&](int start, int end) noexcept { tanks.tick(start, end); });
+    RebuildTanksGrid();
+}
+
+//Destroyed tanks go in a partition of their own so hits can skip them
+void Game::RebuildTanksGrid()
+{
+    tanks_grid.rebuild(
+        pool, tanks.size(),
+        [&](int i) noexcept { return UniformGrid<Tank>::Entry{tanks[i].Get_Position(), tanks[i]}; },
+        [&](int i) noexcept { return tanks[i].Is_Active() ? int(tanks[i].Get_Allignment()) : destroyed_partition; });
+}
 
-                const auto old_position = tank->Get_Position();
-                tank->Tick();
-                tanks_hash.tryUpdateAt(old_position, tank->Get_Position(), tank);
+//Moves the active tanks to their current position in tanks_hasher and takes out the ones destroyed since the last update
+void Game::UpdateTanksHasher()
+{
+    pool.parallel_for(0, tanks.size(), tanks_grain, [&](int start, int end) noexcept
+    {
+        for (int i = start; i < end; i++)
+        {
+            auto tank = tanks[i];
+            if (!tank.Is_Active())
+            {
+                if (hashed[i]) tanks_hasher.tryRemoveAt(hashed_positions[i], tank);
+                hashed[i] = false;
+                continue;
             }
+
+            const vec2 position = tank.Get_Position();
+            hashed[i] = hashed[i] ? tanks_hasher.tryUpdateAt(hashed_positions[i], position, tank) : tanks_hasher.tryInsertAt(position, tank);
+            hashed_positions[i] = position;
         }
-    };
+    });
+}
 
-    RunParallel(updateTanks, tanks.size());
+//Reloaded tanks are gathered per team, then the targets of a whole team are found in one batch query on the enemy tree
+void Game::FireRockets()
+{
+    ProfileZone zone(profiler, Phase::FireRockets);
+    for (auto& team_shooters : shooters) team_shooters.clear();
 
-    bool trees_rebuild = false;
     for (int i = 0; i < tanks.size(); i++)
     {
         auto tank = tanks[i];
+        if (tank.Is_Active() && tank.Rocket_Reloaded()) shooters[tank.Get_Allignment()].push_back(i);
+    }
+
+    //Only frames in which a tank fires pay for bringing the targeting engine up to date
+    if (shooters[BLUE].empty() && shooters[RED].empty()) return;
+    if (targeting == Targeting::KDTree)
+    {
+        blue_tree.refit();
+        red_tree.refit();
+    }
+    else
+    {
+        UpdateTanksHasher();
+    }
 
-        //Shoot at closest target if reloaded
-        if (tank->active && tank->Rocket_Reloaded())
+    for (const allignments allignment : {BLUE, RED})
+    {
+        const auto& team_shooters = shooters[allignment];
+        if (team_shooters.empty()) continue;
+
+        //Last target of every shooter is where the search starts, it usually still is the closest enemy
+        shooter_positions.clear();
+        shooter_targets.clear();
+        for (const int i : team_shooters)
+        {
+            shooter_positions.push_back(tanks[i].Get_Position());
+            shooter_targets.push_back(last_targets[i]);
+        }
+
+        if (targeting == Targeting::KDTree)
         {
-            if (trees_rebuild == false)
+            const KDTree& enemies = allignment == BLUE ? red_tree : blue_tree;
+            enemies.findNearestNeighbours(pool, shooter_positions, shooter_targets);
+        }
+        else
+        {
+            pool.parallel_for(0, int(shooter_positions.size()), targets_grain, [&](int start, int end) noexcept
             {
-                blue_tree.rebuild();
-                red_tree.rebuild();
-                trees_rebuild = true;
-            }
+                for (int j = start; j < end; j++) shooter_targets[j] = tanks_hasher.findClosestEnemy(shooter_positions[j], allignment);
+            });
+        }
 
-            auto target = tank->allignment == BLUE ? red_tree.findNearestNeighbour(tank->position) : blue_tree.findNearestNeighbour(tank->position);
-            rockets.push_back(Rocket(tank->position, (target->Get_Position() - tank->position).normalized() * 3, rocket_radius, tank->allignment, ((tank->allignment == RED) ? &rocket_red : &rocket_blue)));
-            tank->Reload_Rocket();
+        for (int j = 0; j < int(team_shooters.size()); j++)
+        {
+            auto tank = tanks[team_shooters[j]];
+            const auto target = shooter_targets[j];
+            if (target.store == nullptr) continue; //No enemies left
+
+            const auto position = tank.Get_Position();
+            rockets.spawn(Rocket(position, (target.Get_Position() - position).normalized() * 3, rocket_radius, allignment, ((allignment == RED) ? &rocket_red : &rocket_blue)));
+            tank.Reload_Rocket();
+            last_targets[team_shooters[j]] = target;
         }
     }
+}
 
+void Game::UpdateSmokes()
+{
+    ProfileZone zone(profiler, Phase::UpdateSmokes);
     //Update smoke plumes
-    for (Smoke& smoke : smokes)
-    {
-        smoke.Tick();
-    }
+    smokes.forEach([](Smoke& smoke) noexcept { smoke.Tick(); });
+}
 
+void Game::UpdateRockets()
+{
+    ProfileZone zone(profiler, Phase::UpdateRockets);
+    const auto& world = tanks_grid.getBoundary();
     auto updateRockets = [&](int start, int end) noexcept
     {
         //Update rockets
         for (auto i = start; i < end; i++)
         {
+            if (!rockets.isAlive(i)) continue;
+
             auto& rocket = rockets[i];
             rocket.Tick();
 
+            //Nothing left to hit for rockets that flew off the battlefield
+            if (rocket.age > ROCKET_MAX_AGE || !contains(world, rocket.position))
+            {
+                rocket.active = false;
+                continue;
+            }
+
             //Check if rocket collides with enemy tank, spawn explosion and if tank is destroyed spawn a smoke plume
-            tanks_hash.forEachWithinBounds({rocket.position, tank_vs_rocket_radius}, [&](const SpatialHasher<Tank*>::Entry& tank) noexcept
+            const int enemies = rocket.allignment == BLUE ? RED : BLUE;
+            tanks_grid.forEachWithinBounds({rocket.position, tank_vs_rocket_radius}, enemies, enemies, [&](const UniformGrid<Tank>::Entry& tank) noexcept
             {
-                if (tank.object->active && (tank.object->allignment != rocket.allignment) && rocket.Intersects(tank.object->position, tank.object->collision_radius))
+                if (tank.object.Is_Active() && rocket.Intersects(tank.position, tank.object.Get_collision_radius()))
                 {
-                    std::unique_lock<std::mutex>(explosions_mutex), explosions.push_back(Explosion(&explosion, tank.object->position));
+                    explosion_spawns.push(Explosion(&explosion, tank.position));
 
-                    if (tank.object->hit(ROCKET_HIT_VALUE))
+                    if (tank.object.hit(ROCKET_HIT_VALUE))
                     {
-                        std::unique_lock<std::mutex>(smokes_mutex), smokes.push_back(Smoke(smoke, tank.object->position - vec2(0, 48)));
+                        smoke_spawns.push(Smoke(&smoke, tank.position - vec2(0, 48)));
                     }
 
                     rocket.active = false;
@@ -252,90 +441,160 @@ void Game::Update(float deltaTime)
         }
     };
 
-    RunParallel(updateRockets, rockets.size());
+    pool.parallel_for(0, rockets.slotCount(), rockets_grain, updateRockets);
 
-    //Remove exploded rockets with remove erase idiom
-    rockets.erase(std::remove_if(rockets.begin(), rockets.end(), [](const Rocket& rocket) { return !rocket.active; }), rockets.end());
+    //Recycle the slots of exploded rockets and add what they spawned
+    rockets.killIf([](const Rocket& rocket) noexcept { return !rocket.active; });
+    explosions.spawn(explosion_spawns);
+    smokes.spawn(smoke_spawns);
 
+    profiler.count(Counter::LiveRockets, float(rockets.size()));
+}
+
+void Game::UpdateParticleBeams()
+{
+    ProfileZone zone(profiler, Phase::UpdateParticleBeams);
     //Update particle beams
     for (Particle_beam& particle_beam : particle_beams)
     {
         particle_beam.tick();
 
-        //Damage all tanks within the damage window of the beam (the window is an axis-aligned bounding box)
-        tanks_hash.forEachWithinBounds({particle_beam.rectangle.min-tank_radius, particle_beam.rectangle.max+tank_radius}, [&](const SpatialHasher<Tank*>::Entry& tank) noexcept
+        //Damage all tanks within the damage window of the beam (the window is an axis-aligned bounding box), of either team
+        tanks_grid.forEachWithinBounds({particle_beam.rectangle.min-tank_radius, particle_beam.rectangle.max+tank_radius}, BLUE, RED, [&](const UniformGrid<Tank>::Entry& tank) noexcept
         {
-            if (tank.object->active && particle_beam.rectangle.intersectsCircle(tank.object->Get_Position(), tank.object->Get_collision_radius()))
+            if (tank.object.Is_Active() && particle_beam.rectangle.intersectsCircle(tank.position, tank.object.Get_collision_radius()))
             {
-                if (tank.object->hit(particle_beam.damage))
+                if (tank.object.hit(particle_beam.damage))
                 {
-                    smokes.push_back(Smoke(smoke, tank.object->position - vec2(0, 48)));
+                    smokes.spawn(Smoke(&smoke, tank.position - vec2(0, 48)));
                 }
             }
         });
     }
+}
+
+void Game::UpdateExplosions()
+{
+    ProfileZone zone(profiler, Phase::UpdateExplosions);
+    //Update explosion sprites and recycle them when done
+    explosions.forEach([](Explosion& explosion) noexcept { explosion.Tick(); });
+    explosions.killIf([](const Explosion& explosion) noexcept { return explosion.done(); });
+}
+
+//Copy the render state of this frame, vectors keep their capacity so this doesn't allocate once warmed up
+void Game::CaptureSnapshot()
+{
+    ProfileZone zone(profiler, Phase::CaptureSnapshot);
+    RenderSnapshot& snapshot = *captured_snapshot;
+
+    snapshot.tanks = tanks;
 
-    //Update explosion sprites and remove when done with remove erase idiom
-    for (Explosion& explosion : explosions)
+    //Health bars are drawn per team, blue first, whatever order the tanks are stored in
+    snapshot.health.clear();
+    for (const allignments allignment : {BLUE, RED})
     {
-        explosion.Tick();
+        for (int i = 0; i < tanks.size(); i++)
+        {
+            if (tanks.allignment[i] == allignment) snapshot.health.push_back(tanks.health[i]);
+        }
     }
 
-    explosions.erase(std::remove_if(explosions.begin(), explosions.end(), [](const Explosion& explosion) { return explosion.done(); }), explosions.end());
+    snapshot.rockets.clear();
+    snapshot.smokes.clear();
+    snapshot.explosions.clear();
+    rockets.forEach([&](const Rocket& rocket) noexcept { snapshot.rockets.push_back(rocket); });
+    smokes.forEach([&](const Smoke& smoke) noexcept { snapshot.smokes.push_back(smoke); });
+    explosions.forEach([&](const Explosion& explosion) noexcept { snapshot.explosions.push_back(explosion); });
+    snapshot.particle_beams = particle_beams;
 }
 
-void Game::Draw()
+void Game::DrawBackground()
 {
-    // clear the graphics window
-    screen->Clear(0);
-
-    //Draw background
-    background.Draw(screen, 0, 0);
+    ProfileZone zone(profiler, Phase::DrawBackground);
+    //Only the parts of the screen that were drawn over last frame are restored from the background
+    renderer.beginRestore(&background_cache);
+}
 
+void Game::DrawTanks()
+{
+    ProfileZone zone(profiler, Phase::DrawTanks);
     //Draw sprites
-    for (int i = 0; i < NUM_TANKS_BLUE + NUM_TANKS_RED; i++)
+    for (int i = 0; i < drawn_snapshot->tanks.size(); i++)
     {
-        tanks.at(i)->Draw(screen);
+        drawn_snapshot->tanks[i].Draw(renderer);
+    }
+}
 
-        vec2 tPos = tanks.at(i)->Get_Position();
-        // tread marks
-        if ((tPos.x >= 0) && (tPos.x < SCRWIDTH) && (tPos.y >= 0) && (tPos.y < SCRHEIGHT))
-            background.GetBuffer()[(int)tPos.x + (int)tPos.y * SCRWIDTH] = SubBlend(background.GetBuffer()[(int)tPos.x + (int)tPos.y * SCRWIDTH], 0x808080);
+void Game::DrawRockets()
+{
+    ProfileZone zone(profiler, Phase::DrawRockets);
+    for (const Rocket& rocket : drawn_snapshot->rockets)
+    {
+        rocket.Draw(renderer);
     }
+}
 
-    for (Rocket& rocket : rockets)
+void Game::DrawSmokes()
+{
+    ProfileZone zone(profiler, Phase::DrawSmokes);
+    for (const Smoke& smoke : drawn_snapshot->smokes)
     {
-        rocket.Draw(screen);
+        smoke.Draw(renderer);
     }
+}
 
-    for (Smoke& smoke : smokes)
+void Game::DrawParticleBeams()
+{
+    ProfileZone zone(profiler, Phase::DrawParticleBeams);
+    for (const Particle_beam& particle_beam : drawn_snapshot->particle_beams)
     {
-        smoke.Draw(screen);
+        particle_beam.Draw(renderer);
     }
+}
 
-    auto drawParticleBeams = [&](int start, int end) noexcept
+void Game::DrawExplosions()
+{
+    ProfileZone zone(profiler, Phase::DrawExplosions);
+    for (const Explosion& explosion : drawn_snapshot->explosions)
     {
-        for (int i = start; i < end; i++)
-        {
-            particle_beams[i].Draw(screen);
-        }
-    };
+        explosion.Draw(renderer);
+    }
+}
 
-    RunParallel(drawParticleBeams, particle_beams.size(), 3);
+//Draws everything recorded since DrawBackground, every tile of the screen on its own
+void Game::Rasterize()
+{
+    ProfileZone zone(profiler, Phase::Rasterize);
+    renderer.render(pool, screen);
 
-    for (Explosion& explosion : explosions)
+    //Tread marks go into the background after it has been drawn, so they show up from the next frame on like they always did
+    Pixel* background_buffer = background_cache.GetBuffer();
+    for (int i = 0; i < drawn_snapshot->tanks.size(); i++)
     {
-        explosion.Draw(screen);
+        vec2 tPos = drawn_snapshot->tanks[i].Get_Position();
+        if ((tPos.x >= 0) && (tPos.x < SCRWIDTH) && (tPos.y >= 0) && (tPos.y < SCRHEIGHT))
+        {
+            background_buffer[(int)tPos.x + (int)tPos.y * SCRWIDTH] = SubBlend(background_buffer[(int)tPos.x + (int)tPos.y * SCRWIDTH], 0x808080);
+            renderer.markDirty((int)tPos.x, (int)tPos.y, (int)tPos.x + 1, (int)tPos.y + 1);
+        }
     }
+}
 
-    //Draw sorted health bars
-    auto copy = tanks; //Copy tanks for mergesort
+//Draw sorted health bars
+void Game::DrawHealthBars()
+{
+    ProfileZone zone(profiler, Phase::DrawHealthBars);
+    auto& health = drawn_snapshot->health;
+    auto copy = health; //Copy health for mergesort
     for (int t = 0; t < 2; t++)
     {
-        const UINT16 NUM_TANKS = ((t < 1) ? NUM_TANKS_BLUE : NUM_TANKS_RED);
+        const int NUM_TANKS = ((t < 1) ? scenario.tanks_blue : scenario.tanks_red);
 
-        const UINT16 begin = ((t < 1) ? 0 : NUM_TANKS_BLUE);
-        splitmerge_tanks_health(tanks, copy, begin, begin + NUM_TANKS);
+        const int begin = ((t < 1) ? 0 : scenario.tanks_blue);
+        splitmerge_health(health, copy, begin, begin + NUM_TANKS);
+
+        //Bars aren't clipped, so only the unhealthiest ones that fit on the screen are drawn
+        const int fitting = (SCRWIDTH - 1 - HEALTH_BAR_WIDTH - HEALTH_BARS_OFFSET_X) / (HEALTH_BAR_WIDTH + HEALTH_BAR_SPACING) + 1;
 
         auto drawHealthBar = [&](int start, int end) noexcept
         {
@@ -347,15 +606,20 @@ void Game::Draw()
                 int health_bar_end_y = (t < 1) ? HEALTH_BAR_HEIGHT : SCRHEIGHT - 1;
 
                 screen->Bar(health_bar_start_x, health_bar_start_y, health_bar_end_x, health_bar_end_y, REDMASK);
-                screen->Bar(health_bar_start_x, health_bar_start_y + (int)((double)HEALTH_BAR_HEIGHT * (1 - ((double)tanks.at(begin + i)->health / (double)TANK_MAX_HEALTH))), health_bar_end_x, health_bar_end_y, GREENMASK);
+                screen->Bar(health_bar_start_x, health_bar_start_y + (int)((double)HEALTH_BAR_HEIGHT * (1 - ((double)health[begin + i] / (double)scenario.tank_max_health))), health_bar_end_x, health_bar_end_y, GREENMASK);
             }
         };
 
-        RunParallel(drawHealthBar, NUM_TANKS);
+        pool.parallel_for(0, std::min(NUM_TANKS, fitting), health_bars_grain, drawHealthBar);
+
+        //Bars are drawn straight onto the screen, so the renderer has to restore them next frame
+        const int bars = std::min(NUM_TANKS, fitting);
+        const int bars_y = (t < 1) ? 0 : (SCRHEIGHT - HEALTH_BAR_HEIGHT) - 1;
+        if (bars > 0) renderer.markDirty(HEALTH_BARS_OFFSET_X, bars_y, (bars - 1) * (HEALTH_BAR_WIDTH + HEALTH_BAR_SPACING) + HEALTH_BARS_OFFSET_X + HEALTH_BAR_WIDTH + 1, bars_y + HEALTH_BAR_HEIGHT + 1);
     }
 }
 
-void Tmpl8::Game::splitmerge_tanks_health_p(std::vector<Tank*>& A, std::vector<Tank*>& B, UINT16 begin, UINT16 end, int d) noexcept
+void Tmpl8::Game::splitmerge_health_p(std::vector<int>& A, std::vector<int>& B, int begin, int end, int d) noexcept
 {
     if (end - begin <= 1)
         return;
@@ -364,39 +628,40 @@ void Tmpl8::Game::splitmerge_tanks_health_p(std::vector<Tank*>& A, std::vector<T
 
     if (d < thread_count)
     {
-        auto f = pool.enqueue([&]() noexcept { splitmerge_tanks_health_p(B, A, begin, middle, d * 2); });
-        splitmerge_tanks_health_p(B, A, middle, end, d * 2);
-        f.wait();
+        TaskGroup left;
+        pool.enqueue([&]() noexcept { splitmerge_health_p(B, A, begin, middle, d * 2); }, left);
+        splitmerge_health_p(B, A, middle, end, d * 2);
+        pool.wait(left);
     }
     else
     {
-        splitmerge_tanks_health(B, A, begin, middle);
-        splitmerge_tanks_health(B, A, middle, end);
+        splitmerge_health(B, A, begin, middle);
+        splitmerge_health(B, A, middle, end);
     }
 
-    merge_tanks_health(B, A, begin, middle, end);
+    merge_health(B, A, begin, middle, end);
 }
 
-void Tmpl8::Game::splitmerge_tanks_health(std::vector<Tank*>& A, std::vector<Tank*>& B, UINT16 begin, UINT16 end) noexcept
+void Tmpl8::Game::splitmerge_health(std::vector<int>& A, std::vector<int>& B, int begin, int end) noexcept
 {
     if (end - begin <= 1)
         return;
 
     const auto middle = (end + begin) / 2;
-    splitmerge_tanks_health(B, A, begin, middle);
-    splitmerge_tanks_health(B, A, middle, end);
+    splitmerge_health(B, A, begin, middle);
+    splitmerge_health(B, A, middle, end);
 
-    merge_tanks_health(B, A, begin, middle, end);
+    merge_health(B, A, begin, middle, end);
 }
 
-void Tmpl8::Game::merge_tanks_health(std::vector<Tank*>& A, std::vector<Tank*>& B, UINT16 begin, UINT16 middle, UINT16 end) noexcept
+void Tmpl8::Game::merge_health(std::vector<int>& A, std::vector<int>& B, int begin, int middle, int end) noexcept
 {
     auto i = begin;
     auto j = middle;
 
     for (auto k = begin; k < end; k++)
     {
-        if (i < middle && (j >= end || A[i]->health <= A[j]->health))
+        if (i < middle && (j >= end || A[i] <= A[j]))
         {
             B[k] = A[i++];
         }
@@ -408,20 +673,27 @@ void Tmpl8::Game::merge_tanks_health(std::vector<Tank*>& A, std::vector<Tank*>&
 }
 
 // -----------------------------------------------------------
-// When we reach MAX_FRAMES print the duration and speedup multiplier
+// When we reach the last frame of the scenario print the duration and speedup multiplier
 // Updating REF_PERFORMANCE at the top of this file with the value
 // on your machine gives you an idea of the speedup your optimizations give
 // -----------------------------------------------------------
 void Tmpl8::Game::MeasurePerformance()
 {
     char buffer[128];
-    if (frame_count >= MAX_FRAMES)
+    if (frame_count >= scenario.max_frames)
     {
         if (!lock_update)
         {
             duration = perf_timer.elapsed();
-            cout << "Duration was: " << duration << " (Replace REF_PERFORMANCE with this value)" << endl;
             lock_update = true;
+
+            if (report)
+            {
+                cout << "Duration was: " << duration << " (Replace REF_PERFORMANCE with this value)" << endl;
+                profiler.printSummary();
+                profiler.writeFramesCsv(PROFILE_FRAMES_FILE);
+                profiler.writeSummaryJson(PROFILE_SUMMARY_FILE);
+            }
         }
 
         frame_count--;
@@ -429,6 +701,8 @@ void Tmpl8::Game::MeasurePerformance()
 
     if (lock_update)
     {
+        //Drawn over everything once the game is done, restoring the whole screen next frame is simpler than marking all of it
+        renderer.invalidate();
         screen->Bar(420, 170, 870, 430, 0x030000);
         int ms = (int)duration % 1000, sec = ((int)duration / 1000) % 60, min = ((int)duration / 60000);
         sprintf(buffer, "%02i:%02i:%03i", min, sec, ms);
@@ -445,9 +719,19 @@ void Game::Tick(float deltaTime)
 {
     if (!lock_update)
     {
-        Update(deltaTime);
+        profiler.beginFrame();
+        {
+            ProfileZone zone(profiler, Phase::Frame);
+            frame_graph.run();
+        }
+        profiler.endFrame();
+
+        if (!lockstep) std::swap(captured_snapshot, drawn_snapshot);
+    }
+    else
+    {
+        Draw();
     }
-    Draw();
 
     MeasurePerformance();
 
@@ -461,4 +745,5 @@ void Game::Tick(float deltaTime)
     frame_count++;
     string frame_count_string = "FRAME: " + std::to_string(frame_count);
     frame_count_font->Print(screen, frame_count_string.c_str(), 350, 580);
+    renderer.markDirty(350, 580, 350 + frame_count_font->Width(frame_count_string.c_str()), 580 + frame_count_font->Height());
 }
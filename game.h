@@ -8,15 +8,29 @@ class Game
 
   public:
 
+    //Engine that finds the closest enemy of every tank that fires
+    enum class Targeting
+    {
+        KDTree,
+        TanksHasher
+    };
+
+    explicit Game(const Scenario& scenario = Scenario());
+
     void SetTarget(Surface* surface) { screen = surface; }
+    void SetLockstep(bool enabled) { lockstep = enabled; } //Draw each frame after its own Update instead of overlapping it with the next, call before Init
+    void SetTargeting(Targeting engine) { targeting = engine; }
+    void SetReorderInterval(int frames) { reorder_interval = frames; } //Sort the tanks in memory by position every this many frames, 0 never
+    void SetReport(bool enabled) { report = enabled; } //Print and write the profile after the last frame, on by default. Call before Init
     void Init();
     void Shutdown();
-    void Update(float deltaTime);
     void Draw();
     void Tick(float deltaTime);
     void MeasurePerformance();
+    bool Finished() const { return lock_update; }
+    const Profiler& GetProfiler() const { return profiler; }
 
-    Tank* FindClosestEnemy(Tank* current_tank);
+    Tank FindClosestEnemy(Tank current_tank);
 
     void MouseUp(int button)
     { /* implement if you want to detect mouse button presses */
@@ -40,36 +54,87 @@ class Game
 
   private:
 
-    static const unsigned int thread_count;
+    const Scenario scenario;
+
+    const unsigned int thread_count;
     ThreadPool pool{thread_count-1};
 
-    mutex rockets_mutex;
-    mutex smokes_mutex;
-    mutex explosions_mutex;
+    SpawnBuffer<Smoke> smoke_spawns{pool};
+    SpawnBuffer<Explosion> explosion_spawns{pool};
 
     Surface* screen;
 
-    vector<Tank*> tanks;
-    SpatialHasher<Tank*> tanks_hash = SpatialHasher<Tank*>({{-100, -100}, {1400, 1700}}, 25);
+    TankStore tanks;
+    //Partitions of tanks_grid are the allignments, followed by the tanks that were destroyed before the last rebuild
+    static constexpr int destroyed_partition = RED + 1;
+    UniformGrid<Tank> tanks_grid = UniformGrid<Tank>(scenario.world, scenario.cell_size, destroyed_partition + 1);
+    SweepAndPrune tanks_sweep;
+
+    int reorder_interval = 64;
+    vector<uint32_t> morton_codes, morton_scratch; //Reused by ReorderTanks
+    vector<int> tank_order, order_scratch, new_index;
     KDTree red_tree;
     KDTree blue_tree;
 
-    vector<Rocket> rockets;
-    vector<Smoke> smokes;
-    vector<Explosion> explosions;
+    Targeting targeting = Targeting::KDTree;
+    TanksHasher tanks_hasher{scenario.world, scenario.cell_size};
+    vector<vec2> hashed_positions; //Per tank, where tanks_hasher stores it
+    vector<char> hashed;           //Per tank, whether tanks_hasher stores it
+
+    //Reused every frame by FireRockets: the reloaded tanks per team, and the queries and results of one batch
+    vector<int> shooters[2];
+    vector<vec2> shooter_positions;
+    vector<Tank> shooter_targets;
+    vector<Tank> last_targets; //Per tank, the target of its last rocket
+
+    EntityPool<Rocket> rockets;
+    EntityPool<Smoke> smokes;
+    EntityPool<Explosion> explosions;
     vector<Particle_beam> particle_beams;
 
     Font* frame_count_font;
     long long frame_count = 0;
 
     bool lock_update = false;
-
-    template<typename Callable_T>
-    void RunParallel(const Callable_T& callable, int N, unsigned int max_threads = thread_count) noexcept;
-
-    void splitmerge_tanks_health_p(std::vector<Tank*>& A, std::vector<Tank*>& B, UINT16 begin, UINT16 end, int d = 1) noexcept;
-    void splitmerge_tanks_health(std::vector<Tank*>& A, std::vector<Tank*>& B, UINT16 begin, UINT16 end) noexcept;
-    void merge_tanks_health(std::vector<Tank*>& A, std::vector<Tank*>& B, UINT16 begin, UINT16 middle, UINT16 end) noexcept;
+    bool report = true;
+
+    Profiler profiler;
+
+    TaskGraph frame_graph{pool};
+    TileRenderer renderer{SCRWIDTH, SCRHEIGHT, 128};
+    //The background as drawn on a cleared screen, plus the tread marks. The renderer restores the screen from it
+    Surface background_cache{SCRWIDTH, SCRHEIGHT};
+
+    bool lockstep = false;
+    RenderSnapshot snapshots[2];
+    RenderSnapshot* captured_snapshot = &snapshots[0];
+    RenderSnapshot* drawn_snapshot = &snapshots[1];
+
+    void BuildFrameGraph();
+
+    void ReorderTanks();
+    void UpdateTanks();
+    void RebuildTanksGrid();
+    void UpdateTanksHasher();
+    void FireRockets();
+    void UpdateSmokes();
+    void UpdateRockets();
+    void UpdateParticleBeams();
+    void UpdateExplosions();
+    void CaptureSnapshot();
+
+    void DrawBackground();
+    void DrawTanks();
+    void DrawRockets();
+    void DrawSmokes();
+    void DrawParticleBeams();
+    void DrawExplosions();
+    void Rasterize();
+    void DrawHealthBars();
+
+    void splitmerge_health_p(std::vector<int>& A, std::vector<int>& B, int begin, int end, int d = 1) noexcept;
+    void splitmerge_health(std::vector<int>& A, std::vector<int>& B, int begin, int end) noexcept;
+    void merge_health(std::vector<int>& A, std::vector<int>& B, int begin, int middle, int end) noexcept;
 
 };
 
@@ -3,23 +3,93 @@
 namespace Tmpl8
 {
 
+//Compares 'point' with the 'count' bucket positions in 'x' and 'y', 8 (AVX) or 4 (SSE) at once.
+//The arrays have to be readable up to 'count' rounded up to 8, with infinitely far positions as padding.
+//Returns the slot of the closest position that is closer than 'closest_distance' and updates that, or -1 when there is none
+inline int searchBucketSlots(const float* x, const float* y, const int count, const vec2& point, float& closest_distance) noexcept
+{
+#ifdef __AVX__
+    constexpr int width = 8;
+    const __m256 px = _mm256_set1_ps(point.x), py = _mm256_set1_ps(point.y);
+#else
+    constexpr int width = 4;
+    const __m128 px = _mm_set1_ps(point.x), py = _mm_set1_ps(point.y);
+#endif
+
+    int closest_slot = -1;
+    for (int i = 0; i < count; i += width)
+    {
+        alignas(32) float distances[width];
+#ifdef __AVX__
+        const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), px);
+        const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), py);
+        const __m256 distance = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        if (_mm256_movemask_ps(_mm256_cmp_ps(distance, _mm256_set1_ps(closest_distance), _CMP_LT_OQ)) == 0) continue;
+        _mm256_store_ps(distances, distance);
+#else
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), px);
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), py);
+        const __m128 distance = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        if (_mm_movemask_ps(_mm_cmplt_ps(distance, _mm_set1_ps(closest_distance))) == 0) continue;
+        _mm_store_ps(distances, distance);
+#endif
+
+        // At least one lane is closer, pick the closest in slot order.
+        for (int lane = 0; lane < width; lane++)
+        {
+            if (distances[lane] < closest_distance)
+            {
+                closest_distance = distances[lane];
+                closest_slot = i + lane;
+            }
+        }
+    }
+
+    return closest_slot;
+}
+
+//Nearest neighbour tree over a range of tanks. The split structure is built once and then kept,
+//refit() only recomputes the bounds and alive counts of every node as tanks move and die.
+//Queries prune by those bounds instead of the split planes, so they stay exact however far the tanks moved since the build
+//Tanks live in leaf buckets of up to bucket_size positions that are compared with searchBucketSlots
 class KDTree final
 {
 
 public:
 
     KDTree() noexcept = default;
-    KDTree(std::vector<Tank*> values, int begin, int end) noexcept;
+    KDTree(TankStore& tanks, int begin, int end) noexcept;
     KDTree(const KDTree& other) noexcept = delete;
     KDTree(KDTree&& other) noexcept = default;
 
     KDTree& operator=(const KDTree& tree) noexcept = delete;
     KDTree& operator=(KDTree&& tree) noexcept = default;
 
+    //Drops the destroyed tanks and builds new split planes
     void rebuild() noexcept;
 
-    Tank* findNearestNeighbour(vec2 point) noexcept;
-    Tank* findNearestNeighbour_norecursion(vec2 point) noexcept;
+    //Updates the bounds to the current tank positions, rebuilds instead when the tree has become too loose or too empty
+    void refit() noexcept;
+
+    //Points the tree at the new indices after TankStore::reorder, tank i moved to new_index[i]
+    void remap(const std::vector<int>& new_index) noexcept;
+
+    //How queries walk the tree, both find the same tank
+    enum class Traversal
+    {
+        Recursive,
+        Stack //Iterative depth first with a fixed size stack
+    };
+
+    void setTraversal(Traversal traversal) noexcept { this->traversal = traversal; }
+
+    //Uses the traversal set with setTraversal
+    Tank findNearestNeighbour(vec2 point) const noexcept;
+    Tank findNearestNeighbour_norecursion(vec2 point) const noexcept;
+
+    //Nearest active tank for every query, split over the threads of 'pool'.
+    //Every 'out' entry that holds an active tank of this tree on entry, e.g. the result of an earlier frame, bounds the search from the start
+    void findNearestNeighbours(ThreadPool& pool, span<const vec2> queries, span<Tank> out) const noexcept;
 
     ~KDTree() noexcept = default;
 
@@ -32,127 +102,322 @@ private:
 
 	struct Node
     {
-        Tank* value = nullptr;
         Axis axis = Axis::X;
+        float split = 0.f;
 
         Node* left = nullptr;
         Node* right = nullptr;
+
+        //Leaves only, the tanks are in slots [bucket * bucket_size, bucket * bucket_size + count) of the bucket arrays
+        int bucket = 0;
+        int count = 0;
+
+        //Bounds of the active tanks in this subtree, only valid when 'alive' isn't 0
+        vec2 min, max;
+        int alive = 0;
+
+        bool isLeaf() const noexcept { return left == nullptr; }
 	};
 
+    static constexpr int bucket_size = 16;
+    //Deepest tree the stack traversal can walk, 2^32 buckets
+    static constexpr int max_depth = 32;
+    static_assert(bucket_size % 8 == 0, "Buckets are searched a whole SIMD vector at a time!");
+    //Queries per task of findNearestNeighbours
+    static constexpr int query_grain = 32;
+
+    //Rebuild once the summed half perimeters of all node bounds grew this much since the last build
+    static constexpr float rebuild_cost_ratio = 1.5f;
+    //or once less than this part of the tanks in the tree is still active
+    static constexpr float rebuild_alive_ratio = 0.5f;
+
+    std::vector<Tank> tanks; //Every tank in the tree, reordered by build
     std::vector<Node> nodes;
-    Node* root;
+    Node* root = nullptr;
+    float built_cost = 0.f;
+    Traversal traversal = Traversal::Recursive;
+
+    //Bucket slots of dead tanks and unused slots hold an infinitely far position, so SIMD never has to mask them
+    std::vector<Tank> bucket_tanks;
+    std::vector<float> bucket_x;
+    std::vector<float> bucket_y;
 
     Node* build(int begin, int end, int depth = 0) noexcept;
-    void findNearestNeighbour(const vec2& point, Node* node, Tank*& closest_tank, float& closest_distance) noexcept;
+    float refit(Node* node) noexcept;
+    void findNearestNeighbour(const vec2& point, Tank& closest_tank, float& closest_distance) const noexcept;
+    void findNearestNeighbour(const vec2& point, const Node* node, Tank& closest_tank, float& closest_distance) const noexcept;
+    void findNearestNeighbour_norecursion(const vec2& point, Tank& closest_tank, float& closest_distance) const noexcept;
+    void searchBucket(const vec2& point, const Node& leaf, Tank& closest_tank, float& closest_distance) const noexcept;
 
+    static float sqrDistanceToBounds(const vec2& point, const Node& node) noexcept;
 };
 
-inline KDTree::KDTree(std::vector<Tank*> values, int begin, int end) noexcept
+inline KDTree::KDTree(TankStore& tanks, int begin, int end) noexcept
 {
-    this->nodes.reserve(end-begin);
+    this->tanks.reserve(end-begin);
     for (int i = begin; i < end; i++) {
-        nodes.push_back(Node{values[i]});
+        this->tanks.push_back(tanks[i]);
     }
 
-    this->root = build(0, nodes.size());
+    rebuild();
 }
 
 inline void KDTree::rebuild() noexcept
 {
-    this->root = build(0, nodes.size());
+    const auto dead = [](const Tank& tank) noexcept { return !tank.Is_Active(); };
+    this->tanks.erase(std::remove_if(this->tanks.begin(), this->tanks.end(), dead), this->tanks.end());
+
+    // Nodes point at each other, so the storage must never move while building.
+    this->nodes.clear();
+    this->nodes.reserve(2 * this->tanks.size());
+    this->bucket_tanks.clear();
+    this->bucket_x.clear();
+    this->bucket_y.clear();
+
+    this->root = build(0, tanks.size());
+    this->built_cost = refit(this->root);
+}
+
+inline void KDTree::refit() noexcept
+{
+    const float cost = refit(this->root);
+    const int alive = this->root == nullptr ? 0 : this->root->alive;
+
+    if (cost > built_cost * rebuild_cost_ratio || alive < tanks.size() * rebuild_alive_ratio)
+        rebuild();
+}
+
+inline void KDTree::remap(const std::vector<int>& new_index) noexcept
+{
+    for (Tank& tank : this->tanks) tank.index = new_index[tank.index];
+
+    // Unused bucket slots hold invalid tanks.
+    for (Tank& tank : this->bucket_tanks)
+    {
+        if (tank.index >= 0) tank.index = new_index[tank.index];
+    }
 }
 
 inline KDTree::Node* KDTree::build(int begin, int end, int depth) noexcept
 {
     if (begin >= end) return nullptr;
+    assert(depth < max_depth && "KDTree is too deep for the stack traversal!");
+
+    this->nodes.emplace_back();
+    Node& current_node = this->nodes.back();
+
+    if (end - begin <= bucket_size)
+    {
+        current_node.bucket = int(this->bucket_tanks.size()) / bucket_size;
+        current_node.count = end - begin;
+
+        this->bucket_tanks.insert(this->bucket_tanks.end(), this->tanks.begin() + begin, this->tanks.begin() + end);
+        this->bucket_tanks.resize(this->bucket_tanks.size() + bucket_size - current_node.count);
+        this->bucket_x.resize(this->bucket_tanks.size(), std::numeric_limits<float>::infinity());
+        this->bucket_y.resize(this->bucket_tanks.size(), std::numeric_limits<float>::infinity());
+
+        return &current_node;
+    }
 
     Axis axis = Axis(depth % 2);
     const auto middle = begin + (end - begin) / 2;
 
-    { // Partially sort 'nodes' such that the object pointed to by middle_it appears at the same index as if 'nodes' had been fully sorted.
-        const auto begin_it = this->nodes.begin() + begin;
-        const auto middle_it = this->nodes.begin() + middle;
-        const auto end_it = this->nodes.begin() + end;
-        const auto comparator = [=](const Node& a, const Node& b) noexcept { return a.value->position.cell[axis] < b.value->position.cell[axis]; };
+    { // Partially sort 'tanks' such that the object pointed to by middle_it appears at the same index as if 'tanks' had been fully sorted.
+        const auto begin_it = this->tanks.begin() + begin;
+        const auto middle_it = this->tanks.begin() + middle;
+        const auto end_it = this->tanks.begin() + end;
+        const auto comparator = [=](const Tank& a, const Tank& b) noexcept { return a.Get_Position().cell[axis] < b.Get_Position().cell[axis]; };
         std::nth_element(begin_it, middle_it, end_it, comparator);
     } // Done sorting
 
-    Node& current_node = this->nodes[middle];
     current_node.axis = axis;
+    current_node.split = this->tanks[middle].Get_Position().cell[axis];
     current_node.left = build(begin, middle, depth + 1);
-    current_node.right = build(middle + 1, end, depth + 1);
+    current_node.right = build(middle, end, depth + 1);
     
     return &current_node;
 }
 
-inline Tank* KDTree::findNearestNeighbour(vec2 point) noexcept
+//Recomputes bounds, alive counts and bucket positions bottom up, returns the summed half perimeters of the subtree as a measure of how loose it is
+inline float KDTree::refit(Node* node) noexcept
 {
-    Tank* closest_tank = nullptr;
+    if (node == nullptr) return 0.f;
+
+    float cost = 0.f;
+    node->alive = 0;
+
+    const auto grow = [node](vec2 min, vec2 max) noexcept
+    {
+        if (node->alive == 0)
+        {
+            node->min = min;
+            node->max = max;
+        }
+        else
+        {
+            node->min = {std::min(node->min.x, min.x), std::min(node->min.y, min.y)};
+            node->max = {std::max(node->max.x, max.x), std::max(node->max.y, max.y)};
+        }
+    };
+
+    if (node->isLeaf())
+    {
+        const int first = node->bucket * bucket_size;
+        for (int i = first; i < first + node->count; i++)
+        {
+            if (bucket_tanks[i].Is_Active())
+            {
+                const vec2 position = bucket_tanks[i].Get_Position();
+                bucket_x[i] = position.x, bucket_y[i] = position.y;
+                grow(position, position);
+                node->alive++;
+            }
+            else
+            {
+                bucket_x[i] = bucket_y[i] = std::numeric_limits<float>::infinity();
+            }
+        }
+    }
+    else
+    {
+        cost += refit(node->left) + refit(node->right);
+
+        for (const Node* child : {node->left, node->right})
+        {
+            if (child->alive == 0) continue;
+            grow(child->min, child->max);
+            node->alive += child->alive;
+        }
+    }
+
+    if (node->alive > 0) cost += (node->max.x - node->min.x) + (node->max.y - node->min.y);
+    return cost;
+}
+
+inline float KDTree::sqrDistanceToBounds(const vec2& point, const Node& node) noexcept
+{
+    const float dx = std::max(std::max(node.min.x - point.x, point.x - node.max.x), 0.f);
+    const float dy = std::max(std::max(node.min.y - point.y, point.y - node.max.y), 0.f);
+    return dx * dx + dy * dy;
+}
+
+inline Tank KDTree::findNearestNeighbour(vec2 point) const noexcept
+{
+    Tank closest_tank;
     float closest_distance = std::numeric_limits<float>::infinity();
-    findNearestNeighbour(point, this->root, closest_tank, closest_distance);
+    findNearestNeighbour(point, closest_tank, closest_distance);
 
     return closest_tank;
 }
 
-inline void KDTree::findNearestNeighbour(const vec2& point, Node* node, Tank*& closest_tank, float& closest_distance) noexcept
+inline void KDTree::findNearestNeighbour(const vec2& point, Tank& closest_tank, float& closest_distance) const noexcept
+{
+    if (traversal == Traversal::Stack)
+        findNearestNeighbour_norecursion(point, closest_tank, closest_distance);
+    else
+        findNearestNeighbour(point, this->root, closest_tank, closest_distance);
+}
+
+inline void KDTree::findNearestNeighbours(ThreadPool& pool, span<const vec2> queries, span<Tank> out) const noexcept
 {
-    if (node == nullptr) return;
+    assert(queries.size() == out.size() && "Every query needs an output!");
 
-    if (node->value->active)
+    pool.parallel_for(0, queries.size(), query_grain, [&](int start, int end) noexcept
     {
-        const auto distance = (node->value->position - point).sqrLength();
-        if (distance < closest_distance)
+        for (int i = start; i < end; i++)
         {
-            closest_distance = distance;
-            closest_tank = node->value;
+            Tank closest_tank = out[i];
+            float closest_distance = std::numeric_limits<float>::infinity();
+
+            if (closest_tank.store != nullptr && closest_tank.Is_Active())
+                closest_distance = (closest_tank.Get_Position() - queries[i]).sqrLength();
+            else
+                closest_tank = Tank();
+
+            findNearestNeighbour(queries[i], closest_tank, closest_distance);
+            out[i] = closest_tank;
         }
-    }
+    });
+}
 
-    if (closest_distance == 0)
-        return;
+inline void KDTree::findNearestNeighbour(const vec2& point, const Node* node, Tank& closest_tank, float& closest_distance) const noexcept
+{
+    // Subtrees without active tanks, or that can't hold anything closer, are skipped entirely.
+    if (node == nullptr || node->alive == 0) return;
+    if (sqrDistanceToBounds(point, *node) >= closest_distance) return;
 
-    float dx = node->value->position.cell[node->axis] - point.cell[node->axis];
-    findNearestNeighbour(point, dx > 0 ? node->left : node->right, closest_tank, closest_distance);
-    if (dx * dx >= closest_distance)
+    if (node->isLeaf())
+    {
+        searchBucket(point, *node, closest_tank, closest_distance);
         return;
-    findNearestNeighbour(point, dx > 0 ? node->right : node->left, closest_tank, closest_distance);
+    }
+
+    // The split plane may be stale after refits, it only decides which side is likely closer and gets visited first.
+    const bool left_first = point.cell[node->axis] < node->split;
+    findNearestNeighbour(point, left_first ? node->left : node->right, closest_tank, closest_distance);
+    findNearestNeighbour(point, left_first ? node->right : node->left, closest_tank, closest_distance);
+}
+
+inline void KDTree::searchBucket(const vec2& point, const Node& leaf, Tank& closest_tank, float& closest_distance) const noexcept
+{
+    const int first = leaf.bucket * bucket_size;
+    const int slot = searchBucketSlots(&bucket_x[first], &bucket_y[first], leaf.count, point, closest_distance);
+    if (slot >= 0) closest_tank = bucket_tanks[first + slot];
 }
 
-inline Tank* KDTree::findNearestNeighbour_norecursion(vec2 point) noexcept
+inline Tank KDTree::findNearestNeighbour_norecursion(vec2 point) const noexcept
 {
-    Tank* closest_tank = nullptr;
+    Tank closest_tank;
     float closest_distance = std::numeric_limits<float>::infinity();
+    findNearestNeighbour_norecursion(point, closest_tank, closest_distance);
 
-    std::deque<Node*> nodes;
-    nodes.push_back(this->root);
+    return closest_tank;
+}
 
-    while (!nodes.empty())
+//Descends to the nearest leaf first and leaves the far children on a stack, together with the distance to their bounds.
+//The bounds take the place of the splitting planes here because those may be stale after refits, they prune at least as much.
+//Every descent pushes at most one node per level, so the stack never holds more than the depth of the tree
+inline void KDTree::findNearestNeighbour_norecursion(const vec2& point, Tank& closest_tank, float& closest_distance) const noexcept
+{
+    struct Pending
     {
-        Node* current_node = nodes.front();
-        nodes.pop_front();
+        const Node* node;
+        float distance;
+    };
+
+    if (this->root == nullptr || this->root->alive == 0) return;
 
-        if (current_node == nullptr) continue;
+    Pending stack[max_depth + 1];
+    int top = 0;
+    stack[top++] = {this->root, sqrDistanceToBounds(point, *this->root)};
 
-        if (current_node->value->active)
+    const auto distanceTo = [&point](const Node* node) noexcept
+    {
+        return node->alive == 0 ? std::numeric_limits<float>::infinity() : sqrDistanceToBounds(point, *node);
+    };
+
+    while (top > 0)
+    {
+        const Pending pending = stack[--top];
+
+        // The search may have come closer since this node was pushed.
+        if (pending.distance >= closest_distance) continue;
+
+        const Node* node = pending.node;
+        while (node != nullptr && !node->isLeaf())
         {
-            const auto distance = (current_node->value->position - point).sqrLength();
-            if (distance < closest_distance)
-            {
-                closest_distance = distance;
-                closest_tank = current_node->value;
-            }
-        }
+            const bool left_first = point.cell[node->axis] < node->split;
+            const Node* near_node = left_first ? node->left : node->right;
+            const Node* far_node = left_first ? node->right : node->left;
 
-        if (closest_distance == 0)
-            break;
+            const float far_distance = distanceTo(far_node);
+            if (far_distance < closest_distance) stack[top++] = {far_node, far_distance};
 
-        float dx = current_node->value->position[current_node->axis] - point[current_node->axis];
-        nodes.push_back(dx > 0 ? current_node->left : current_node->right);
-        if (dx * dx >= closest_distance) continue;
-        nodes.push_back(dx > 0 ? current_node->right : current_node->left);
-    }
+            node = distanceTo(near_node) < closest_distance ? near_node : nullptr;
+        }
 
-    return closest_tank;
+        if (node != nullptr) searchBucket(point, *node, closest_tank, closest_distance);
+    }
 }
 
 } // namespace Tmpl8
@@ -0,0 +1,67 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Spreads the lower 16 bits of 'value' over the even bits of the result
+inline uint32_t spreadBits(uint32_t value) noexcept
+{
+    value &= 0x0000ffff;
+    value = (value | (value << 8)) & 0x00ff00ff;
+    value = (value | (value << 4)) & 0x0f0f0f0f;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+//Position along the Z-order curve through 'boundary', positions that are close together mostly get close codes.
+//Positions outside of the boundary are clamped onto its edge
+inline uint32_t mortonCode(const vec2 position, const BoundingBox& boundary) noexcept
+{
+    const auto quantize = [](float value, float min, float max) noexcept
+    {
+        const float t = std::min(std::max((value - min) / (max - min), 0.f), 1.f);
+        return uint32_t(t * 65535.f);
+    };
+
+    const uint32_t x = quantize(position.x, boundary.min.x, boundary.max.x);
+    const uint32_t y = quantize(position.y, boundary.min.y, boundary.max.y);
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+//Stable least significant digit radix sort of 'values' by 'keys', 8 bits per pass. The scratch vectors are resized as needed,
+//pass the same ones every time to avoid allocating
+inline void radixSort(std::vector<uint32_t>& keys, std::vector<int>& values, std::vector<uint32_t>& key_scratch, std::vector<int>& value_scratch) noexcept
+{
+    assert(keys.size() == values.size() && "Every value needs a key!");
+
+    const size_t count = keys.size();
+    key_scratch.resize(count);
+    value_scratch.resize(count);
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        size_t offsets[256] = {};
+        for (const uint32_t key : keys) offsets[(key >> shift) & 0xff]++;
+
+        size_t offset = 0;
+        for (auto& digit : offsets)
+        {
+            const size_t digits = digit;
+            digit = offset;
+            offset += digits;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const size_t destination = offsets[(keys[i] >> shift) & 0xff]++;
+            key_scratch[destination] = keys[i];
+            value_scratch[destination] = values[i];
+        }
+
+        keys.swap(key_scratch);
+        values.swap(value_scratch);
+    }
+}
+
+} // namespace Tmpl8
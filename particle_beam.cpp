@@ -25,15 +25,14 @@ void Particle_beam::tick()
     }
 }
 
-void Particle_beam::Draw(Surface* screen)
+void Particle_beam::Draw(TileRenderer& renderer) const
 {
     vec2 position = rectangle.min;
 
     const int offsetX = 23;
     const int offsetY = 137;
 
-    particle_beam_sprite->SetFrame(sprite_frame / 10);
-    particle_beam_sprite->Draw(screen, (int)(position.x - offsetX), (int)(position.y - offsetY));
+    renderer.submit(particle_beam_sprite, sprite_frame / 10, (int)(position.x - offsetX), (int)(position.y - offsetY));
 }
 
 } // namespace Tmpl8
\ No newline at end of file
@@ -9,7 +9,7 @@ class Particle_beam
     Particle_beam(vec2 min, vec2 max, Sprite* particle_beam_sprite, int damage);
 
     void tick();
-    void Draw(Surface* screen);
+    void Draw(TileRenderer& renderer) const;
 
     vec2 min_position;
     vec2 max_position;
@@ -30,6 +30,9 @@
 // Extra definitions for redirectIO
 #include <fcntl.h>
 #include <io.h>
+
+// For __cpuid, when picking the sprite blitter
+#include <intrin.h>
 #endif
 
 // External dependencies:
@@ -42,20 +45,26 @@
 
 // C++ headers
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <numeric>
 #include <random>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <limits>
 
+#include <atomic>
+#include <condition_variable>
 #include <thread>
 #include <mutex>
 #include <shared_mutex>
 #include <deque>
 #include <future>
+#include <functional>
 
 // Namespaced C headers:
 #include <cassert>
@@ -69,6 +78,13 @@
 // See: https://stackoverflow.com/a/11228864/2844473
 #include <immintrin.h>
 
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 // clang-format off
 
 // "Leak" common namespaces to all compilation units. This is not standard
@@ -76,23 +92,37 @@
 using namespace std;
 
 #include "surface.h"
+#include "blitter.h"
 #include "template.h"
+#include "span.h"
 
 using namespace Tmpl8;
 
 #include "thread_pool.h"
+#include "task_graph.h"
+#include "tile_renderer.h"
+#include "entity_pool.h"
+#include "profiler.h"
 
 #include "tank.h"
 #include "rocket.h"
 #include "smoke.h"
 #include "explosion.h"
 #include "particle_beam.h"
+#include "render_snapshot.h"
 
 #include "boundary.h"
+#include "scenario.h"
 #include "spatial_hasher.h"
+#include "tanks_hasher.h"
+#include "uniform_grid.h"
+#include "sweep_and_prune.h"
 
+#include "morton.h"
 #include "kd_tree.h"
+#include "flat_kd_tree.h"
 
 #include "game.h"
+#include "benchmarks.h"
 
 // clang-format on
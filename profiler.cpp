@@ -0,0 +1,235 @@
+#include "precomp.h" // include (only) this in every .cpp file
+
+namespace Tmpl8
+{
+
+const char* Profiler::name(const Phase phase) noexcept
+{
+    static const char* names[phase_count] = {
+        "reorder_tanks",
+        "update_tanks",
+        "fire_rockets",
+        "update_smokes",
+        "update_rockets",
+        "update_particle_beams",
+        "update_explosions",
+        "capture_snapshot",
+        "draw_background",
+        "draw_tanks",
+        "draw_rockets",
+        "draw_smokes",
+        "draw_particle_beams",
+        "draw_explosions",
+        "rasterize",
+        "draw_health_bars",
+        "frame"};
+
+    return names[static_cast<int>(phase)];
+}
+
+const char* Profiler::name(const Counter counter) noexcept
+{
+    static const char* names[counter_count] = {
+        "live_rockets",
+        "l1d_misses",
+        "llc_misses"};
+
+    return names[static_cast<int>(counter)];
+}
+
+#ifdef __linux__
+static int openCacheCounter(const pid_t thread, const uint64_t cache) noexcept
+{
+    perf_event_attr attributes{};
+    attributes.size = sizeof(attributes);
+    attributes.type = PERF_TYPE_HW_CACHE;
+    attributes.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+
+    return int(syscall(SYS_perf_event_open, &attributes, thread, -1, -1, 0));
+}
+#endif
+
+bool CacheCounters::open() noexcept
+{
+#ifdef __linux__
+    DIR* threads = opendir("/proc/self/task");
+    if (!threads) return false;
+
+    bool opened = true;
+    while (const dirent* thread = readdir(threads))
+    {
+        if (thread->d_name[0] == '.') continue;
+
+        const int l1d_fd = openCacheCounter(pid_t(atoi(thread->d_name)), PERF_COUNT_HW_CACHE_L1D);
+        const int llc_fd = openCacheCounter(pid_t(atoi(thread->d_name)), PERF_COUNT_HW_CACHE_LL);
+        if (l1d_fd >= 0) l1d.push_back(l1d_fd);
+        if (llc_fd >= 0) llc.push_back(llc_fd);
+
+        // Missing a single thread would silently undercount, so it's all or nothing.
+        if (l1d_fd < 0 || llc_fd < 0)
+        {
+            opened = false;
+            break;
+        }
+    }
+    closedir(threads);
+
+    if (!opened) release();
+    return isOpen();
+#else
+    return false;
+#endif
+}
+
+void CacheCounters::read(uint64_t& l1d_misses, uint64_t& llc_misses) const noexcept
+{
+    l1d_misses = llc_misses = 0;
+
+#ifdef __linux__
+    const auto sum = [](const std::vector<int>& fds) noexcept
+    {
+        uint64_t total = 0;
+        for (const int fd : fds)
+        {
+            uint64_t value = 0;
+            if (::read(fd, &value, sizeof(value)) == sizeof(value)) total += value;
+        }
+        return total;
+    };
+
+    l1d_misses = sum(l1d);
+    llc_misses = sum(llc);
+#endif
+}
+
+void CacheCounters::release() noexcept
+{
+#ifdef __linux__
+    for (const int fd : l1d) close(fd);
+    for (const int fd : llc) close(fd);
+#endif
+    l1d.clear();
+    llc.clear();
+}
+
+Profiler::Stats Profiler::calculateStats(const Phase phase) const noexcept
+{
+    std::vector<float> samples;
+    samples.reserve(frames.size());
+    for (const auto& frame : frames)
+    {
+        samples.push_back(frame[static_cast<int>(phase)]);
+    }
+
+    return calculateStats(samples);
+}
+
+Profiler::Stats Profiler::calculateStats(const Counter counter) const noexcept
+{
+    std::vector<float> samples;
+    samples.reserve(counters.size());
+    for (const auto& values : counters)
+    {
+        samples.push_back(values[static_cast<int>(counter)]);
+    }
+
+    return calculateStats(samples);
+}
+
+Profiler::Stats Profiler::calculateStats(std::vector<float>& samples) noexcept
+{
+    if (samples.empty()) return Stats{0, 0, 0, 0, 0};
+
+    std::sort(samples.begin(), samples.end());
+
+    Stats stats;
+    stats.min = samples.front();
+    stats.median = samples[samples.size() / 2];
+    stats.p99 = samples[std::max<size_t>(1, size_t(std::ceil(samples.size() * 0.99))) - 1];
+    stats.max = samples.back();
+    stats.total = 0;
+    for (const auto sample : samples) stats.total += sample;
+
+    return stats;
+}
+
+// -----------------------------------------------------------
+// One row per frame, one column (in milliseconds) per phase
+// followed by one column per counter
+// -----------------------------------------------------------
+bool Profiler::writeFramesCsv(const char* file) const noexcept
+{
+    std::ofstream out(file);
+    if (!out) return false;
+
+    out << "frame";
+    for (int p = 0; p < phase_count; p++) out << ',' << name(Phase(p));
+    for (int c = 0; c < counter_count; c++) out << ',' << name(Counter(c));
+    out << '\n';
+
+    for (size_t f = 0; f < frames.size(); f++)
+    {
+        out << f;
+        for (int p = 0; p < phase_count; p++) out << ',' << frames[f][p];
+        for (int c = 0; c < counter_count; c++) out << ',' << counters[f][c];
+        out << '\n';
+    }
+
+    return bool(out);
+}
+
+bool Profiler::writeSummaryJson(const char* file) const noexcept
+{
+    std::ofstream out(file);
+    if (!out) return false;
+
+    out << "{\n    \"frames\": " << frames.size() << ",\n    \"phases\": {\n";
+    for (int p = 0; p < phase_count; p++)
+    {
+        const auto stats = calculateStats(Phase(p));
+        out << "        \"" << name(Phase(p)) << "\": {"
+            << "\"min\": " << stats.min << ", "
+            << "\"median\": " << stats.median << ", "
+            << "\"p99\": " << stats.p99 << ", "
+            << "\"max\": " << stats.max << ", "
+            << "\"total\": " << stats.total << "}"
+            << ((p + 1 < phase_count) ? ",\n" : "\n");
+    }
+    out << "    },\n    \"counters\": {\n";
+    for (int c = 0; c < counter_count; c++)
+    {
+        const auto stats = calculateStats(Counter(c));
+        out << "        \"" << name(Counter(c)) << "\": {"
+            << "\"min\": " << stats.min << ", "
+            << "\"median\": " << stats.median << ", "
+            << "\"p99\": " << stats.p99 << ", "
+            << "\"max\": " << stats.max << "}"
+            << ((c + 1 < counter_count) ? ",\n" : "\n");
+    }
+    out << "    }\n}\n";
+
+    return bool(out);
+}
+
+void Profiler::printSummary() const noexcept
+{
+    printf("%-24s %10s %10s %10s %10s %12s\n", "phase (ms)", "min", "median", "p99", "max", "total");
+    for (int p = 0; p < phase_count; p++)
+    {
+        const auto stats = calculateStats(Phase(p));
+        printf("%-24s %10.3f %10.3f %10.3f %10.3f %12.1f\n", name(Phase(p)), stats.min, stats.median, stats.p99, stats.max, stats.total);
+    }
+
+    printf("%-24s %10s %10s %10s %10s\n", "counter", "min", "median", "p99", "max");
+    for (int c = 0; c < counter_count; c++)
+    {
+        const auto stats = calculateStats(Counter(c));
+        printf("%-24s %10.0f %10.0f %10.0f %10.0f\n", name(Counter(c)), stats.min, stats.median, stats.p99, stats.max);
+    }
+
+    if (!cache_counters.isOpen()) printf("(cache counters unavailable, %s and %s stay 0)\n", name(Counter::L1DMisses), name(Counter::LLCMisses));
+}
+
+} // namespace Tmpl8
@@ -0,0 +1,178 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// Phases of a frame that are timed individually.
+enum class Phase
+{
+    ReorderTanks,
+    UpdateTanks,
+    FireRockets,
+    UpdateSmokes,
+    UpdateRockets,
+    UpdateParticleBeams,
+    UpdateExplosions,
+    CaptureSnapshot,
+    DrawBackground,
+    DrawTanks,
+    DrawRockets,
+    DrawSmokes,
+    DrawParticleBeams,
+    DrawExplosions,
+    Rasterize,
+    DrawHealthBars,
+    Frame,
+    Count
+};
+
+// Values sampled once per frame next to the phase timings.
+enum class Counter
+{
+    LiveRockets,
+    L1DMisses,
+    LLCMisses,
+    Count
+};
+
+// Hardware counters of the L1 data and last level cache read misses of every thread in the process.
+// Only implemented on Linux, and only works where perf events can reach a PMU.
+class CacheCounters
+{
+
+public:
+
+    CacheCounters() noexcept = default;
+    CacheCounters(const CacheCounters& other) = delete;
+    CacheCounters& operator=(const CacheCounters& other) = delete;
+    ~CacheCounters() noexcept { release(); }
+
+    // Counts the threads that exist right now, so open once all workers have been started.
+    bool open() noexcept;
+    bool isOpen() const noexcept { return !l1d.empty(); }
+
+    // Misses since open(), summed over all threads.
+    void read(uint64_t& l1d_misses, uint64_t& llc_misses) const noexcept;
+
+private:
+
+    std::vector<int> l1d, llc; // One file descriptor per thread
+
+    void release() noexcept;
+
+};
+
+class Profiler
+{
+
+public:
+
+    static constexpr int phase_count = static_cast<int>(Phase::Count);
+    static constexpr int counter_count = static_cast<int>(Counter::Count);
+
+    struct Stats
+    {
+        float min, median, p99, max, total;
+    };
+
+    Profiler() noexcept = default;
+
+    // Adds the cache misses of every frame as counters, false when the hardware counters can't be opened. The summary says when they couldn't.
+    bool enableCacheCounters() noexcept { return cache_counters.open(); }
+
+    void beginFrame() noexcept;
+    void endFrame() noexcept;
+    void record(Phase phase, float milliseconds) noexcept;
+    void count(Counter counter, float value) noexcept;
+
+    Stats calculateStats(Phase phase) const noexcept;
+    Stats calculateStats(Counter counter) const noexcept;
+    size_t frameCount() const noexcept { return frames.size(); }
+
+    bool writeFramesCsv(const char* file) const noexcept;
+    bool writeSummaryJson(const char* file) const noexcept;
+    void printSummary() const noexcept;
+
+    static const char* name(Phase phase) noexcept;
+    static const char* name(Counter counter) noexcept;
+
+private:
+
+    using Frame_T = std::array<float, phase_count>;
+    using Counters_T = std::array<float, counter_count>;
+
+    std::vector<Frame_T> frames;
+    std::vector<Counters_T> counters;
+    bool recording = false;
+
+    CacheCounters cache_counters;
+    uint64_t l1d_misses_at_begin = 0, llc_misses_at_begin = 0;
+
+    static Stats calculateStats(std::vector<float>& samples) noexcept;
+
+};
+
+// Times the enclosing scope and records it as 'phase' of the current frame.
+class ProfileZone
+{
+
+public:
+
+    ProfileZone(Profiler& profiler, Phase phase) noexcept : profiler(profiler), phase(phase) {}
+    ProfileZone(const ProfileZone& other) = delete;
+    ProfileZone& operator=(const ProfileZone& other) = delete;
+
+    ~ProfileZone() noexcept { profiler.record(phase, time.elapsed()); }
+
+private:
+
+    Profiler& profiler;
+    Phase phase;
+    timer time;
+
+};
+
+inline void Profiler::beginFrame() noexcept
+{
+    Frame_T frame;
+    frame.fill(0.f);
+    frames.push_back(frame);
+
+    Counters_T values;
+    values.fill(0.f);
+    counters.push_back(values);
+
+    recording = true;
+
+    if (cache_counters.isOpen()) cache_counters.read(l1d_misses_at_begin, llc_misses_at_begin);
+}
+
+inline void Profiler::endFrame() noexcept
+{
+    if (recording && cache_counters.isOpen())
+    {
+        uint64_t l1d_misses, llc_misses;
+        cache_counters.read(l1d_misses, llc_misses);
+        count(Counter::L1DMisses, float(l1d_misses - l1d_misses_at_begin));
+        count(Counter::LLCMisses, float(llc_misses - llc_misses_at_begin));
+    }
+
+    recording = false;
+}
+
+inline void Profiler::record(const Phase phase, const float milliseconds) noexcept
+{
+    // Phases drawn outside of a measured frame (e.g. after MAX_FRAMES) are ignored.
+    if (!recording) return;
+
+    frames.back()[static_cast<int>(phase)] += milliseconds;
+}
+
+inline void Profiler::count(const Counter counter, const float value) noexcept
+{
+    if (!recording) return;
+
+    counters.back()[static_cast<int>(counter)] = value;
+}
+
+} // namespace Tmpl8
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Copy of everything Draw needs, so one frame can be drawn while the next one is simulated
+struct RenderSnapshot
+{
+    TankStore tanks;
+    vector<int> health; //Per tank, blue ones first, sorted in place by the health bars
+
+    vector<Rocket> rockets;
+    vector<Smoke> smokes;
+    vector<Explosion> explosions;
+    vector<Particle_beam> particle_beams;
+};
+
+} // namespace Tmpl8
@@ -4,7 +4,7 @@
 namespace Tmpl8
 {
 Rocket::Rocket(vec2 position, vec2 direction, float collision_radius, allignments allignment, Sprite* rocket_sprite)
-    : position(position), speed(direction), collision_radius(collision_radius), allignment(allignment), current_frame(0), rocket_sprite(rocket_sprite), active(true)
+    : position(position), speed(direction), collision_radius(collision_radius), allignment(allignment), current_frame(0), age(0), rocket_sprite(rocket_sprite), active(true)
 {
 }
 
@@ -15,14 +15,15 @@ Rocket::~Rocket()
 void Rocket::Tick()
 {
     position += speed;
+    age++;
     if (++current_frame > 8) current_frame = 0;
 }
 
 //Draw the sprite with the facing based on this rockets movement direction
-void Rocket::Draw(Surface* screen)
+void Rocket::Draw(TileRenderer& renderer) const
 {
-    rocket_sprite->SetFrame(((abs(speed.x) > abs(speed.y)) ? ((speed.x < 0) ? 3 : 0) : ((speed.y < 0) ? 9 : 6)) + (current_frame / 3));
-    rocket_sprite->Draw(screen, (int)position.x - 12, (int)position.y - 12);
+    const unsigned int frame = ((abs(speed.x) > abs(speed.y)) ? ((speed.x < 0) ? 3 : 0) : ((speed.y < 0) ? 9 : 6)) + (current_frame / 3);
+    renderer.submit(rocket_sprite, frame, (int)position.x - 12, (int)position.y - 12);
 }
 
 //Does the given circle collide with this rockets collision circle?
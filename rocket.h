@@ -10,7 +10,7 @@ class Rocket
     ~Rocket();
 
     void Tick();
-    void Draw(Surface* screen);
+    void Draw(TileRenderer& renderer) const;
 
     bool Intersects(vec2 position_other, float radius_other) const;
 
@@ -24,6 +24,7 @@ class Rocket
     allignments allignment;
 
     int current_frame;
+    int age; //Frames since the rocket was fired
     Sprite* rocket_sprite;
 };
 
@@ -0,0 +1,100 @@
+#include "precomp.h" // include (only) this in every .cpp file
+
+namespace Tmpl8
+{
+
+Scenario::Option Scenario::parseOption(const int argc, char** argv, int& i) noexcept
+{
+    if (strncmp(argv[i], "--", 2) != 0) return Option::Unknown;
+
+    const string name = argv[i] + 2;
+    const int count = name == "scenario" ? 1 : valueCount(name);
+    if (count == 0) return Option::Unknown;
+
+    if (i + count >= argc)
+    {
+        printf("--%s needs %d value%s\n", name.c_str(), count, count > 1 ? "s" : "");
+        return Option::Invalid;
+    }
+
+    if (name == "scenario")
+    {
+        return load(argv[++i]) ? Option::Applied : Option::Invalid;
+    }
+
+    stringstream values;
+    for (int v = 1; v <= count; v++) values << argv[i + v] << ' ';
+    i += count;
+
+    if (!apply(name, values))
+    {
+        printf("invalid value for --%s\n", name.c_str());
+        return Option::Invalid;
+    }
+
+    return Option::Applied;
+}
+
+bool Scenario::load(const char* file) noexcept
+{
+    ifstream in(file);
+    if (!in)
+    {
+        printf("can't open scenario '%s'\n", file);
+        return false;
+    }
+
+    string line;
+    while (getline(in, line))
+    {
+        stringstream values(line);
+        string name;
+        if (!(values >> name) || name[0] == '#') continue;
+
+        if (!apply(name, values))
+        {
+            printf("invalid scenario line '%s'\n", line.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Scenario::apply(const string& name, istream& values) noexcept
+{
+    //Parsed into a copy, so an invalid value leaves the scenario as it was
+    Scenario parsed = *this;
+    if (name == "blue") values >> parsed.tanks_blue;
+    else if (name == "red") values >> parsed.tanks_red;
+    else if (name == "health") values >> parsed.tank_max_health;
+    else if (name == "frames") values >> parsed.max_frames;
+    else if (name == "threads") values >> parsed.threads;
+    else if (name == "world") values >> parsed.world.min.x >> parsed.world.min.y >> parsed.world.max.x >> parsed.world.max.y;
+    else if (name == "cell-size") values >> parsed.cell_size;
+    else if (name == "spacing") values >> parsed.spawn_spacing;
+    else if (name == "columns") values >> parsed.spawn_columns;
+    else return false;
+
+    //Anything left over, like the "abc" of "10abc", makes the whole value invalid
+    const bool valid = !values.fail() && (values >> ws).eof() && parsed.tanks_blue >= 0 && parsed.tanks_red >= 0 && parsed.tank_max_health > 0 && parsed.max_frames > 0 && parsed.threads >= 0
+        && parsed.world.min.x < parsed.world.max.x && parsed.world.min.y < parsed.world.max.y && parsed.cell_size > 0 && parsed.spawn_columns > 0;
+    if (valid) *this = parsed;
+
+    return valid;
+}
+
+int Scenario::valueCount(const string& name) noexcept
+{
+    if (name == "world") return 4;
+
+    static const char* single_value[] = {"blue", "red", "health", "frames", "threads", "cell-size", "spacing", "columns"};
+    for (const char* option : single_value)
+    {
+        if (name == option) return 1;
+    }
+
+    return 0;
+}
+
+} // namespace Tmpl8
@@ -0,0 +1,45 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Everything about a run that scaling tests want to vary without rebuilding: the armies, the world they fight in and how long
+//Set from the command line with --<name> <values>, or from a file given by --scenario with one "<name> <values>" per line
+struct Scenario
+{
+    int tanks_blue = 1279;
+    int tanks_red = 1279;
+    int tank_max_health = 1000;
+    int max_frames = 2000;
+
+    //Threads that simulate the game, including the main thread. 0 for one per hardware thread
+    int threads = 0;
+
+    //Area covered by the spatial structures, tanks outside of it are ignored by collisions and targeting
+    BoundingBox world = BoundingBox({-100, -100}, {1400, 1700});
+    float cell_size = 25.0f;
+
+    //Each army spawns as a grid spawn_columns wide, spawn_spacing pixels apart
+    float spawn_spacing = 15.0f;
+    int spawn_columns = 12;
+
+    enum class Option
+    {
+        Unknown, //Not a scenario option, i is left alone
+        Applied,
+        Invalid  //A scenario option with missing or invalid values, or a scenario file that can't be loaded
+    };
+
+    //Applies the option at argv[i] and moves i to its last value. Invalid options print why and leave the scenario as it was
+    Option parseOption(int argc, char** argv, int& i) noexcept;
+
+    //Applies every line of 'file', lines starting with '#' are comments
+    bool load(const char* file) noexcept;
+
+  private:
+
+    bool apply(const string& name, istream& values) noexcept;
+    static int valueCount(const string& name) noexcept;
+};
+
+} // namespace Tmpl8
@@ -8,11 +8,9 @@ void Smoke::Tick()
     if (++current_frame == 60) current_frame = 0;
 }
 
-void Smoke::Draw(Surface* screen)
+void Smoke::Draw(TileRenderer& renderer) const
 {
-    smoke_sprite.SetFrame(current_frame / 15);
-
-    smoke_sprite.Draw(screen, (int)position.x, (int)position.y);
+    renderer.submit(smoke_sprite, current_frame / 15, (int)position.x, (int)position.y);
 }
 
 } // namespace Tmpl8
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Non-owning view of contiguous elements, a minimal stand in for C++20 std::span
+template <typename T>
+class span
+{
+
+public:
+
+    span() noexcept = default;
+    span(T* data, int size) noexcept : first(data), count(size) {}
+
+    template <typename Container_T>
+    span(Container_T& container) noexcept : first(container.data()), count(int(container.size())) {}
+
+    T* data() const noexcept { return first; }
+    int size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+
+    T* begin() const noexcept { return first; }
+    T* end() const noexcept { return first + count; }
+
+    T& operator[](int index) const noexcept
+    {
+        assert(index >= 0 && index < count && "'index' is outside of the span!");
+        return first[index];
+    }
+
+private:
+
+    T* first = nullptr;
+    int count = 0;
+
+};
+
+} // namespace Tmpl8
@@ -24,6 +24,8 @@ public:
     template <typename Callable_T>
     void forEachWithinBounds(BoundingBox boundary, const Callable_T& callable) const noexcept;
 
+    const BoundingBox& getBoundary() const noexcept { return boundary; }
+
 private:
 
     using Container_T = std::vector<std::vector<Entry>>;
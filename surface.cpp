@@ -352,88 +352,58 @@ Sprite::Sprite(Surface* a_Surface, unsigned int a_NumFrames) : m_Width(a_Surface
                                                                m_Height(a_Surface->GetHeight()),
                                                                m_Pitch(a_Surface->GetWidth()),
                                                                m_NumFrames(a_NumFrames),
-                                                               m_CurrentFrame(0),
-                                                               m_Flags(0),
-                                                               m_Start(new unsigned int*[a_NumFrames]),
                                                                m_Surface(a_Surface)
 {
-    InitializeStartData();
+    InitializeSpans();
 }
 
 Sprite::~Sprite()
 {
     delete m_Surface;
-    for (unsigned int i = 0; i < m_NumFrames; i++) delete m_Start[i];
-    delete m_Start;
 }
 
-void Sprite::Draw(Surface* a_Target, int a_X, int a_Y)
+void Sprite::Draw(Surface* a_Target, int a_X, int a_Y, unsigned int a_Frame, unsigned int a_Flags) const
 {
-    //If out of screen skip
-    if ((a_X < -m_Width) || (a_X > (a_Target->GetWidth() + m_Width))) return;
-    if ((a_Y < -m_Height) || (a_Y > (a_Target->GetHeight() + m_Height))) return;
+    DrawClipped(a_Target, a_X, a_Y, a_Frame, a_Flags, 0, 0, a_Target->GetWidth(), a_Target->GetHeight());
+}
 
-    //Get start and end points
-    int x1 = a_X, x2 = a_X + m_Width;
-    int y1 = a_Y, y2 = a_Y + m_Height;
+int Sprite::DrawClipped(Surface* a_Target, int a_X, int a_Y, unsigned int a_Frame, unsigned int a_Flags, int a_X1, int a_Y1, int a_X2, int a_Y2) const
+{
+    //Part of the sprite that is within the clip rectangle, in sprite coordinates
+    const int u1 = max(0, a_X1 - a_X), u2 = min(m_Width, a_X2 - a_X);
+    const int v1 = max(0, a_Y1 - a_Y), v2 = min(m_Height, a_Y2 - a_Y);
+    if ((u2 <= u1) || (v2 <= v1)) return 0;
 
-    //Image start
-    Pixel* src = GetBuffer() + m_CurrentFrame * m_Width;
-    //Set start x to within screen
-    if (x1 < 0)
-    {
-        src += -x1;
-        x1 = 0;
-    }
-    //Set end x to within screen
-    if (x2 > a_Target->GetWidth()) x2 = a_Target->GetWidth();
-    if (y1 < 0)
-    {
-        src += -y1 * m_Pitch;
-        y1 = 0;
-    }
-    if (y2 > a_Target->GetHeight()) y2 = a_Target->GetHeight();
+    //Only the spans are drawn, so no pixel is tested for transparency: opaque spans are copied, flares blended 8 or 4 pixels at a time
+    const bool flare = (a_Flags & FLARE) != 0;
+    const auto blend = activeBlitter().flare;
+
+    const Pixel* src = m_Surface->GetBuffer() + a_Frame * m_Width;
     Pixel* dest = a_Target->GetBuffer();
-    int xs;
     const int dpitch = a_Target->GetPitch();
-    if ((x2 > x1) && (y2 > y1))
+    const int* row_spans = &m_RowSpans[a_Frame * m_Height];
+    int written = 0;
+    for (int v = v1; v < v2; v++)
     {
-        unsigned int addr = y1 * dpitch + x1;
-        const int width = x2 - x1;
-        const int height = y2 - y1;
-        for (int y = 0; y < height; y++)
+        const Pixel* line = src + v * m_Pitch;
+        const int addr = (a_Y + v) * dpitch + a_X;
+        //Spans are sorted, so when clipped skip straight to the first one that ends after u1 and stop at the first one that starts at u2
+        const Span* span = m_Spans.data() + row_spans[v];
+        const Span* last = m_Spans.data() + row_spans[v + 1];
+        if (u1 > 0) span = std::lower_bound(span, last, u1, [](const Span& a_Span, int a_U) { return a_Span.end <= a_U; });
+        for (; (span < last) && (span->start < u2); span++)
         {
-            const int line = y + (y1 - a_Y);
-            const int lsx = m_Start[m_CurrentFrame][line] + a_X;
-            if (m_Flags & FLARE)
-            {
-                xs = (lsx > x1) ? lsx - x1 : 0;
-                for (int x = xs; x < width; x++)
-                {
-                    const Pixel c1 = *(src + x);
-                    if (c1 & 0xffffff)
-                    {
-                        const Pixel c2 = *(dest + addr + x);
-                        *(dest + addr + x) = AddBlend(c1, c2);
-                    }
-                }
-            }
-            else
-            {
-                xs = (lsx > x1) ? lsx - x1 : 0;
-                for (int x = xs; x < width; x++)
-                {
-                    const Pixel c1 = *(src + x);
-                    if (c1 & 0xffffff) *(dest + addr + x) = c1;
-                }
-            }
-            addr += dpitch;
-            src += m_Pitch;
+            const int start = max(span->start, u1), end = min(span->end, u2);
+            written += end - start;
+
+            if (flare) blend(dest + addr + start, line + start, end - start);
+            else memcpy(dest + addr + start, line + start, (end - start) * sizeof(Pixel));
         }
     }
+    return written;
 }
 
-void Sprite::DrawScaled(int a_X, int a_Y, int a_Width, int a_Height, Surface* a_Target)
+void Sprite::DrawScaled(int a_X, int a_Y, int a_Width, int a_Height, Surface* a_Target, unsigned int a_Frame) const
 {
     if ((a_Width == 0) || (a_Height == 0)) return;
     if ((a_X < -a_Width) || (a_X > (a_Target->GetWidth() + a_Width))) return;
@@ -467,9 +437,9 @@ void Sprite::DrawScaled(int a_X, int a_Y, int a_Width, int a_Height, Surface* a_
     {
         for (int y = y_start; y < y_end; y++)
         {
-            int u = (int)((float)x * ((float)m_Width / (float)a_Width)) + m_CurrentFrame * m_Width;
+            int u = (int)((float)x * ((float)m_Width / (float)a_Width)) + a_Frame * m_Width;
             int v = (int)((float)y * ((float)m_Height / (float)a_Height));
-            Pixel color = GetBuffer()[u + v * m_Pitch];
+            Pixel color = m_Surface->GetBuffer()[u + v * m_Pitch];
             if (color & 0xffffff)
             {
                 a_Target->GetBuffer()[a_X + x + ((a_Y + y) * a_Target->GetPitch())] = color;
@@ -478,25 +448,27 @@ void Sprite::DrawScaled(int a_X, int a_Y, int a_Width, int a_Height, Surface* a_
     }
 }
 
-void Sprite::InitializeStartData()
+void Sprite::InitializeSpans()
 {
+    m_RowSpans.reserve(m_NumFrames * m_Height + 1);
     for (unsigned int f = 0; f < m_NumFrames; ++f)
     {
-        m_Start[f] = new unsigned int[m_Height];
         for (int y = 0; y < m_Height; ++y)
         {
-            m_Start[f][y] = m_Width;
-            Pixel* addr = GetBuffer() + f * m_Width + y * m_Pitch;
-            for (int x = 0; x < m_Width; ++x)
+            m_RowSpans.push_back((int)m_Spans.size());
+            const Pixel* addr = GetBuffer() + f * m_Width + y * m_Pitch;
+            int x = 0;
+            while (x < m_Width)
             {
-                if (addr[x])
-                {
-                    m_Start[f][y] = x;
-                    break;
-                }
+                //Skip the transparent pixels, then take the opaque ones up to the next transparent one
+                while ((x < m_Width) && !(addr[x] & 0xffffff)) x++;
+                const int start = x;
+                while ((x < m_Width) && (addr[x] & 0xffffff)) x++;
+                if (x > start) m_Spans.push_back(Span{start, x});
             }
         }
     }
+    m_RowSpans.push_back((int)m_Spans.size());
 }
 
 Font::Font(const char* a_File, const char* a_Chars)
@@ -58,10 +58,11 @@ class Surface
     ~Surface();
     // member data access
     Pixel* GetBuffer() { return m_Buffer; }
+    const Pixel* GetBuffer() const { return m_Buffer; }
     void SetBuffer(Pixel* a_Buffer) { m_Buffer = a_Buffer; }
-    int GetWidth() { return m_Width; }
-    int GetHeight() { return m_Height; }
-    int GetPitch() { return m_Pitch; }
+    int GetWidth() const { return m_Width; }
+    int GetHeight() const { return m_Height; }
+    int GetPitch() const { return m_Pitch; }
     void SetPitch(int a_Pitch) { m_Pitch = a_Pitch; }
     // Special operations
     void InitCharset();
@@ -113,25 +114,30 @@ class Sprite
     Sprite(Surface* a_Surface, unsigned int a_NumFrames);
     ~Sprite();
     // Methods
-    void Draw(Surface* a_Target, int a_X, int a_Y);
-    void DrawScaled(int a_X, int a_Y, int a_Width, int a_Height, Surface* a_Target);
-    void SetFlags(unsigned int a_Flags) { m_Flags = a_Flags; }
-    void SetFrame(unsigned int a_Index) { m_CurrentFrame = a_Index; }
-    unsigned int GetFlags() const { return m_Flags; }
-    int GetWidth() { return m_Width; }
-    int GetHeight() { return m_Height; }
+    // Drawing doesn't change the sprite, so threads can draw the same sprite at once as long as they don't write the same pixels
+    void Draw(Surface* a_Target, int a_X, int a_Y, unsigned int a_Frame, unsigned int a_Flags = 0) const;
+    // Same, but only the pixels in [a_X1, a_X2) x [a_Y1, a_Y2) of the target are touched, returns how many were written
+    int DrawClipped(Surface* a_Target, int a_X, int a_Y, unsigned int a_Frame, unsigned int a_Flags, int a_X1, int a_Y1, int a_X2, int a_Y2) const;
+    void DrawScaled(int a_X, int a_Y, int a_Width, int a_Height, Surface* a_Target, unsigned int a_Frame = 0) const;
+    int GetWidth() const { return m_Width; }
+    int GetHeight() const { return m_Height; }
     Pixel* GetBuffer() { return m_Surface->GetBuffer(); }
-    unsigned int Frames() { return m_NumFrames; }
+    unsigned int Frames() const { return m_NumFrames; }
     Surface* GetSurface() { return m_Surface; }
-    void InitializeStartData();
+    void InitializeSpans();
 
   private:
+    // Run of pixels in one row of a frame that aren't black, [start, end) in sprite coordinates
+    struct Span
+    {
+        int start, end;
+    };
+
     // Attributes
     int m_Width, m_Height, m_Pitch;
     unsigned int m_NumFrames;
-    unsigned int m_CurrentFrame;
-    unsigned int m_Flags;
-    unsigned int** m_Start;
+    std::vector<Span> m_Spans;   // Of every row of every frame, in order
+    std::vector<int> m_RowSpans; // Row y of frame f has spans [m_RowSpans[f * m_Height + y], m_RowSpans[f * m_Height + y + 1])
     Surface* m_Surface;
 };
 
@@ -0,0 +1,180 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Broad phase that finds every pair of objects whose x and y coordinates are both at most 'reach' apart.
+//Objects are binned into horizontal bands one reach high and kept sorted by band, then by x. A sweep along x within a band,
+//and from every band into the one below it, then visits only nearby objects, so the cost grows with the number of objects
+//and not with how many share a stretch of the x axis.
+//Objects barely move between frames, so the order is repaired with an insertion sort that is close to O(n) then
+class SweepAndPrune
+{
+
+public:
+
+    SweepAndPrune() noexcept = default;
+    explicit SweepAndPrune(float reach) noexcept : reach(reach) {}
+
+    //Sorts objects 0 .. count-1 at ('x', 'y'), starting from the order of the last update
+    void update(const float* x, const float* y, int count) noexcept;
+
+    //Renumbers the objects without changing their order, object i became new_index[i]
+    void remap(const std::vector<int>& new_index) noexcept
+    {
+        for (int& object : order) object = new_index[object];
+    }
+
+    //Calls callable(a, b) once for every pair of objects within reach of each other on both axes, in no particular order
+    template <typename Callable_T>
+    void forEachPair(const Callable_T& callable) const noexcept;
+
+    //Same, split over the threads of 'pool'. Calls that run at the same time never share an object,
+    //so the callable may change both of its objects without locking
+    template <typename Callable_T>
+    void forEachPair(ThreadPool& pool, const Callable_T& callable) const noexcept;
+
+private:
+
+    //Objects at sorted positions [begin, end) are all in 'band'
+    struct Run
+    {
+        int band;
+        int begin, end;
+    };
+
+    float reach = 1.f;
+
+    std::vector<int> order;  //Objects sorted by band, then x
+    std::vector<int> bands;  //Band of order[i] at the last update
+    std::vector<float> xs;   //x of order[i] at the last update
+    std::vector<float> ys;   //y of order[i] at the last update, so the sweep rejects pairs without touching the objects
+    std::vector<Run> runs;
+
+    bool before(int band_a, float x_a, int band_b, float x_b) const noexcept { return band_a < band_b || (band_a == band_b && x_a < x_b); }
+
+    template <typename Callable_T>
+    void pairWithin(const Run& run, const Callable_T& callable) const noexcept;
+    template <typename Callable_T>
+    void pairWithNext(int run, const Callable_T& callable) const noexcept;
+
+};
+
+inline void SweepAndPrune::update(const float* x, const float* y, const int count) noexcept
+{
+    const auto bandOf = [this](float y) noexcept { return int(floorf(y / reach)); };
+
+    if (int(order.size()) != count)
+    {
+        // New objects have no order to start from, so sort from scratch.
+        order.resize(count);
+        for (int i = 0; i < count; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) noexcept { return before(bandOf(y[a]), x[a], bandOf(y[b]), x[b]); });
+    }
+
+    bands.resize(count);
+    xs.resize(count);
+    ys.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        bands[i] = bandOf(y[order[i]]);
+        xs[i] = x[order[i]];
+        ys[i] = y[order[i]];
+    }
+
+    for (int i = 1; i < count; i++)
+    {
+        const int band = bands[i];
+        const float key_x = xs[i], key_y = ys[i];
+        const int object = order[i];
+
+        int j = i - 1;
+        for (; j >= 0 && before(band, key_x, bands[j], xs[j]); j--)
+        {
+            bands[j + 1] = bands[j];
+            xs[j + 1] = xs[j];
+            ys[j + 1] = ys[j];
+            order[j + 1] = order[j];
+        }
+
+        bands[j + 1] = band;
+        xs[j + 1] = key_x;
+        ys[j + 1] = key_y;
+        order[j + 1] = object;
+    }
+
+    runs.clear();
+    for (int i = 0; i < count; i++)
+    {
+        if (runs.empty() || runs.back().band != bands[i]) runs.push_back(Run{bands[i], i, i});
+        runs.back().end = i + 1;
+    }
+}
+
+template <typename Callable_T>
+inline void SweepAndPrune::pairWithin(const Run& run, const Callable_T& callable) const noexcept
+{
+    for (int i = run.begin; i < run.end; i++)
+    {
+        for (int j = i + 1; j < run.end && xs[j] - xs[i] <= reach; j++)
+        {
+            if (fabsf(ys[j] - ys[i]) <= reach) callable(order[i], order[j]);
+        }
+    }
+}
+
+//Pairs run 'run' with the run after it, when that holds the band right below
+template <typename Callable_T>
+inline void SweepAndPrune::pairWithNext(const int run, const Callable_T& callable) const noexcept
+{
+    if (run + 1 >= int(runs.size()) || runs[run + 1].band != runs[run].band + 1) return;
+
+    const Run& current = runs[run];
+    const Run& next = runs[run + 1];
+
+    // Both runs are sorted by x, so the start of the window in the next run only ever moves forward.
+    int window = next.begin;
+    for (int i = current.begin; i < current.end; i++)
+    {
+        while (window < next.end && xs[window] < xs[i] - reach) window++;
+
+        for (int j = window; j < next.end && xs[j] <= xs[i] + reach; j++)
+        {
+            if (fabsf(ys[j] - ys[i]) <= reach) callable(order[i], order[j]);
+        }
+    }
+}
+
+template <typename Callable_T>
+inline void SweepAndPrune::forEachPair(const Callable_T& callable) const noexcept
+{
+    for (int run = 0; run < int(runs.size()); run++)
+    {
+        pairWithin(runs[run], callable);
+        pairWithNext(run, callable);
+    }
+}
+
+template <typename Callable_T>
+inline void SweepAndPrune::forEachPair(ThreadPool& pool, const Callable_T& callable) const noexcept
+{
+    const int run_count = int(runs.size());
+    const int grain = std::max(1, run_count / (4 * (int(pool.size()) + 1)));
+
+    // Runs don't share objects, so all of them can be swept at once.
+    pool.parallel_for(0, run_count, grain, [&](int first, int last) noexcept
+    {
+        for (int run = first; run < last; run++) pairWithin(runs[run], callable);
+    });
+
+    // Pairing a run with the next touches both, so first the even runs with their next and then the odd ones.
+    for (const int parity : {0, 1})
+    {
+        pool.parallel_for(0, (run_count + 1 - parity) / 2, grain, [&](int first, int last) noexcept
+        {
+            for (int k = first; k < last; k++) pairWithNext(2 * k + parity, callable);
+        });
+    }
+}
+
+} // namespace Tmpl8
@@ -3,10 +3,14 @@
 namespace Tmpl8
 {
 
-using TanksHasher = SpatialHasher<Tank*>;
+using TanksHasher = SpatialHasher<Tank>;
 
+//Incrementally updated grid of the active tanks that counts the tanks of every team per column and per cell,
+//so findClosestEnemy can skip empty columns and cells while it searches outwards ring by ring.
+//Updates may run in parallel, they lock the row and the column of the cells they change.
+//findClosestEnemy doesn't lock and must not overlap with updates
 template <>
-class SpatialHasher<Tank*>
+class SpatialHasher<Tank>
 {
 
 public:
@@ -14,21 +18,31 @@ public:
     struct Entry
     {
         vec2 position;
-        Tank* object;
+        Tank object;
     };
 
     SpatialHasher(BoundingBox boundary, float cellSize) noexcept;
 
-    bool tryInsertAt(vec2 position, Tank* tank) noexcept;
-    bool tryRemoveAt(vec2 position) noexcept;
+    //All return whether 'tank' is stored in the hasher afterwards, or for tryRemoveAt whether it was removed
+    bool tryInsertAt(vec2 position, Tank tank) noexcept;
+    bool tryUpdateAt(vec2 old_position, vec2 new_position, Tank tank) noexcept;
+    bool tryRemoveAt(vec2 position, Tank tank) noexcept;
 
     template <typename Callable_T>
     void forEachWithinBounds(BoundingBox boundary, const Callable_T& callable) const noexcept;
 
-    Tank* findClosestEnemy(Tank* tank) noexcept;
+    //Points the stored handles at the new indices after TankStore::reorder, tank i moved to new_index[i]. Must not overlap with anything else
+    void remap(const std::vector<int>& new_index) noexcept;
+
+    //Exact closest active tank that isn't of 'allignment', an invalid Tank when there is none
+    Tank findClosestEnemy(vec2 position, allignments allignment) const noexcept;
+
+    const BoundingBox& getBoundary() const noexcept { return boundary; }
 
 private:
 
+    static constexpr int teams = 2;
+
     using Container_T = std::vector<std::vector<Entry>>;
 
     BoundingBox boundary;
@@ -37,12 +51,17 @@ private:
     int rows, cols;
     Container_T cells;
 
-    std::vector<std::vector<int>> tanks_in_col;
-    std::vector<std::vector<std::vector<int>>> tanks_in_cell;
+    //Tanks per team, indexed [col * teams + team], [cell * teams + team] and [team]
+    std::vector<int> tanks_in_col;
+    std::vector<int> tanks_in_cell;
+    std::atomic<int> tanks_in_total[teams];
 
     mutable std::vector<std::shared_mutex> row_mutices;
     mutable std::vector<std::shared_mutex> col_mutices;
 
+    void insert(int row, int col, vec2 position, Tank tank) noexcept;
+    bool remove(int row, int col, Tank tank) noexcept;
+
     int calculateIndex(vec2 position) const noexcept;
 
     int calculateRowIndex(vec2 position) const noexcept;
@@ -67,55 +86,125 @@ inline TanksHasher::SpatialHasher(BoundingBox boundary, float cellSize) noexcept
 
     this->cells = std::vector<std::vector<Entry>>(rows * cols, bucket_prototype);
 
-    this->tanks_in_col = std::vector<std::vector<int>>(cols, {0, 0});
-    this->tanks_in_cell = std::vector<std::vector<std::vector<int>>>(cols, std::vector<std::vector<int>>(rows, {0, 0}));
+    this->tanks_in_col = std::vector<int>(cols * teams, 0);
+    this->tanks_in_cell = std::vector<int>(rows * cols * teams, 0);
+    for (auto& total : tanks_in_total) total.store(0, std::memory_order_relaxed);
 
     this->row_mutices = std::vector<std::shared_mutex>(rows);
     this->col_mutices = std::vector<std::shared_mutex>(cols);
 }
 
-inline bool TanksHasher::tryInsertAt(vec2 position, Tank* tank) noexcept
+inline void TanksHasher::insert(const int row, const int col, const vec2 position, const Tank tank) noexcept
 {
-    if (contains(boundary, position))
+    std::unique_lock<std::shared_mutex> lock_row(row_mutices[row], std::defer_lock);
+    std::unique_lock<std::shared_mutex> lock_col(col_mutices[col], std::defer_lock);
+    std::lock(lock_row, lock_col);
+
+    const auto team = tank.Get_Allignment();
+    cells[row * cols + col].push_back(Entry{position, tank});
+    tanks_in_col[col * teams + team]++;
+    tanks_in_cell[(row * cols + col) * teams + team]++;
+    tanks_in_total[team].fetch_add(1, std::memory_order_relaxed);
+}
+
+inline bool TanksHasher::remove(const int row, const int col, const Tank tank) noexcept
+{
+    std::unique_lock<std::shared_mutex> lock_row(row_mutices[row], std::defer_lock);
+    std::unique_lock<std::shared_mutex> lock_col(col_mutices[col], std::defer_lock);
+    std::lock(lock_row, lock_col);
+
+    auto& cell = cells[row * cols + col];
+    for (auto it = cell.begin(); it != cell.end(); it++)
     {
-        std::unique_lock<std::shared_mutex> lock_row(row_mutices[calculateRowIndex(position)], std::defer_lock);
-        std::unique_lock<std::shared_mutex> lock_col(col_mutices[calculateColIndex(position)], std::defer_lock);
-        std::lock(lock_row, lock_col);
+        if (it->object == tank)
+        {
+            const auto team = tank.Get_Allignment();
+            tanks_in_col[col * teams + team]--;
+            tanks_in_cell[(row * cols + col) * teams + team]--;
+            tanks_in_total[team].fetch_sub(1, std::memory_order_relaxed);
+
+            // Order within a cell doesn't matter, so avoid shifting the rest.
+            *it = cell.back();
+            cell.pop_back();
+            return true;
+        }
+    }
 
-        cells[calculateIndex(position)].push_back(Entry{position, tank});
+    return false;
+}
 
-        tanks_in_col[calculateColIndex(position)][tank->allignment]++;
-        tanks_in_cell[calculateColIndex(position)][calculateRowIndex(position)][tank->allignment]++;
+inline bool TanksHasher::tryInsertAt(vec2 position, Tank tank) noexcept
+{
+    if (contains(boundary, position))
+    {
+        insert(calculateRowIndex(position), calculateColIndex(position), position, tank);
         return true;
     }
 
     return false;
 }
 
-inline bool TanksHasher::tryRemoveAt(vec2 position) noexcept
+inline bool TanksHasher::tryUpdateAt(vec2 old_position, vec2 new_position, Tank tank) noexcept
 {
-    if (contains(boundary, position))
+    if (!contains(boundary, old_position))
+    {
+        // Tank wasn't within the bounds before, but might be again so try to reinsert.
+        return tryInsertAt(new_position, tank);
+    }
+
+    if (!contains(boundary, new_position))
     {
-        std::unique_lock<std::shared_mutex> lock_row(row_mutices[calculateRowIndex(position)], std::defer_lock);
-        std::unique_lock<std::shared_mutex> lock_col(col_mutices[calculateColIndex(position)], std::defer_lock);
+        // Tank isn't within bounds anymore, so just remove it, without reinserting.
+        tryRemoveAt(old_position, tank);
+        return false;
+    }
+
+    const auto old_row = calculateRowIndex(old_position), old_col = calculateColIndex(old_position);
+    const auto new_row = calculateRowIndex(new_position), new_col = calculateColIndex(new_position);
+
+    if (old_row == new_row && old_col == new_col)
+    {
+        // Tank remains within the same cell, so just update its position.
+        std::unique_lock<std::shared_mutex> lock_row(row_mutices[old_row], std::defer_lock);
+        std::unique_lock<std::shared_mutex> lock_col(col_mutices[old_col], std::defer_lock);
         std::lock(lock_row, lock_col);
 
-        auto& cell = cells[calculateIndex(position)];
-        for (auto it = cell.begin(); it != cell.end(); it++)
+        for (auto& entry : cells[old_row * cols + old_col])
         {
-            if (it->position.x == position.x && it->position.y == position.y)
+            if (entry.object == tank)
             {
-                tanks_in_col[calculateColIndex(position)][it->object->allignment]--;
-                tanks_in_cell[calculateColIndex(position)][calculateRowIndex(position)][it->object->allignment]--;
-                cell.erase(it);
+                entry.position = new_position;
                 return true;
             }
         }
+
+        return false;
+    }
+
+    // Tank moves to a different cell, the two cells are locked one after the other so updates can't deadlock.
+    if (!remove(old_row, old_col, tank)) return false;
+    insert(new_row, new_col, new_position, tank);
+    return true;
+}
+
+inline bool TanksHasher::tryRemoveAt(vec2 position, Tank tank) noexcept
+{
+    if (contains(boundary, position))
+    {
+        return remove(calculateRowIndex(position), calculateColIndex(position), tank);
     }
 
     return false;
 }
 
+inline void TanksHasher::remap(const std::vector<int>& new_index) noexcept
+{
+    for (auto& cell : cells)
+    {
+        for (auto& entry : cell) entry.object.index = new_index[entry.object.index];
+    }
+}
+
 template <typename Callable_T>
 inline void TanksHasher::forEachWithinBounds(BoundingBox boundary, const Callable_T& callable) const noexcept
 {
@@ -145,86 +234,68 @@ inline void TanksHasher::forEachWithinBounds(BoundingBox boundary, const Callabl
     }
 }
 
-inline Tank* TanksHasher::findClosestEnemy(Tank* tank) noexcept
+inline Tank TanksHasher::findClosestEnemy(const vec2 position, const allignments allignment) const noexcept
 {
-    const auto tanks_row = calculateRowIndex(tank->position);
-    const auto tanks_col = calculateColIndex(tank->position);
-    const auto enemy_allignment = tank->allignment == BLUE ? RED : BLUE;
+    const auto enemy = allignment == BLUE ? RED : BLUE;
 
-    // Find Closest Column with Enemies
-    int closest_col = cols-1;
+    Tank closest_enemy;
+    float closest_distance = std::numeric_limits<float>::infinity();
+    if (tanks_in_total[enemy].load(std::memory_order_relaxed) == 0) return closest_enemy;
 
-    // Check for closest column on the right first...
-    for (int col = tanks_col; col < cols; col++)
-    {
-        std::shared_lock<std::shared_mutex> lock_col(col_mutices[col]);
-        if (tanks_in_col[col][enemy_allignment] != 0)
-        {
-            closest_col = col;
-            break;
-        }
-    }
+    // Positions outside of the grid search from the closest cell, the distance bound below then just prunes less.
+    const auto center_row = std::min(std::max(calculateRowIndex(position), 0), rows - 1);
+    const auto center_col = std::min(std::max(calculateColIndex(position), 0), cols - 1);
 
-    // Then check if there is a closer column on the left
-    for (int col = tanks_col; col >= 0; col--)
+    const auto searchCell = [&](int row, int col) noexcept
     {
-        std::shared_lock<std::shared_mutex> lock_col(col_mutices[col]);
-        if (tanks_in_col[col][enemy_allignment] != 0)
+        if (tanks_in_cell[(row * cols + col) * teams + enemy] == 0) return;
+
+        for (const auto& entry : cells[row * cols + col])
         {
-            if ((closest_col - tanks_col) >= (tanks_col - col))
+            if (entry.object.Get_Allignment() == enemy && entry.object.Is_Active())
             {
-                closest_col = col;
+                const float distance = (entry.position - position).sqrLength();
+                if (distance < closest_distance)
+                {
+                    closest_distance = distance;
+                    closest_enemy = entry.object;
+                }
             }
-            break;
         }
-    }
-
-    // Find Closest Row with Enemies
-    int closest_row = rows-1;
+    };
 
-    // Check for closest column on the right first...
-    for (int row = tanks_row; row < rows; row++)
+    // Ring r holds the cells whose row and column are at most r away from the center, and exactly r in at least one of them.
+    for (int ring = 0;; ring++)
     {
-        std::shared_lock<std::shared_mutex> lock_row(row_mutices[row]);
-        if (tanks_in_cell[closest_col][row][enemy_allignment] != 0)
+        // Everything in this ring or further lies outside of the square of the cells of the rings before it.
+        if (ring > 0)
         {
-            closest_row = row;
-            break;
+            const float inner_min_x = boundary.min.x + (center_col - ring + 1) * cellSize, inner_max_x = boundary.min.x + (center_col + ring) * cellSize;
+            const float inner_min_y = boundary.min.y + (center_row - ring + 1) * cellSize, inner_max_y = boundary.min.y + (center_row + ring) * cellSize;
+            const float bound = std::max(0.f, std::min(std::min(position.x - inner_min_x, inner_max_x - position.x), std::min(position.y - inner_min_y, inner_max_y - position.y)));
+            if (bound * bound >= closest_distance) break;
         }
-    }
 
-    // Then check if there is a closer column on the left
-    for (int row = tanks_row; row >= 0; row--)
-    {
-        std::shared_lock<std::shared_mutex> lock_row(row_mutices[row]);
-        if (tanks_in_cell[closest_col][row][enemy_allignment] != 0)
+        const int row0 = center_row - ring, rowE = center_row + ring;
+        const int col0 = center_col - ring, colE = center_col + ring;
+        if (row0 < 0 && col0 < 0 && rowE >= rows && colE >= cols) break;
+
+        // Top and bottom row of the ring.
+        for (int col = std::max(col0, 0); col <= std::min(colE, cols - 1); col++)
         {
-            if ((closest_row - tanks_row) >= (tanks_row - row))
-            {
-                closest_row = row;
-            }
-            break;
+            if (tanks_in_col[col * teams + enemy] == 0) continue;
+            if (row0 >= 0) searchCell(row0, col);
+            if (rowE < rows && ring > 0) searchCell(rowE, col);
         }
-    }
 
-    // Find Closest Enemy
-    Tank* closest_enemy = nullptr;
-    float closest_distance = std::numeric_limits<float>::infinity();
-
-    std::shared_lock<std::shared_mutex> lock_row(row_mutices[closest_row], std::defer_lock);
-    std::shared_lock<std::shared_mutex> lock_col(col_mutices[closest_col], std::defer_lock);
-    std::lock(lock_row, lock_col);
-
-    for (const auto& entry : cells[closest_row*cols+closest_col])
-    {
-        if (entry.object->allignment != tank->allignment && entry.object->active)
+        // Left and right column of the ring, without the corners.
+        for (const int col : {col0, colE})
         {
-            float sqrDist = fabsf((entry.object->Get_Position() - tank->Get_Position()).sqrLength());
-            if (sqrDist < closest_distance)
-            {
-                closest_distance = sqrDist;
-                closest_enemy = entry.object;
-            }
+            if (col < 0 || col >= cols) continue;
+            if (tanks_in_col[col * teams + enemy] == 0) continue;
+
+            for (int row = std::max(row0 + 1, 0); row <= std::min(rowE - 1, rows - 1); row++)
+                searchCell(row, col);
         }
     }
 
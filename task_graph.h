@@ -0,0 +1,99 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Bit set of the pieces of state a phase reads or writes
+using ResourceSet = uint32_t;
+
+//Runs a fixed list of phases on the thread pool. Phases are declared in program order together with the
+//state they read and write; a phase only waits for the earlier phases it conflicts with, all others overlap.
+class TaskGraph final
+{
+
+public:
+
+    explicit TaskGraph(ThreadPool& pool) noexcept : pool(pool) {}
+    TaskGraph(const TaskGraph& other) = delete;
+    TaskGraph& operator=(const TaskGraph& other) = delete;
+
+    template <typename Callable_T>
+    void add(ResourceSet reads, ResourceSet writes, Callable_T callable);
+
+    //Runs every phase once and returns when all of them have finished
+    void run() noexcept;
+
+    size_t size() const noexcept { return nodes.size(); }
+
+private:
+
+    struct Node
+    {
+        std::function<void()> work;
+        ResourceSet reads;
+        ResourceSet writes;
+
+        int dependency_count = 0;
+        std::vector<int> successors;
+    };
+
+    ThreadPool& pool;
+    std::vector<Node> nodes;
+    std::unique_ptr<std::atomic<int>[]> remaining;
+
+    TaskGroup running;
+
+    void schedule(int index) noexcept;
+
+};
+
+template <typename Callable_T>
+inline void TaskGraph::add(const ResourceSet reads, const ResourceSet writes, Callable_T callable)
+{
+    const int index = int(nodes.size());
+    nodes.push_back(Node{std::move(callable), reads, writes, 0, {}});
+
+    // Two phases conflict when one of them writes state the other one reads or writes.
+    for (int i = 0; i < index; i++)
+    {
+        const auto& earlier = nodes[i];
+        if ((earlier.writes & (reads | writes)) || (earlier.reads & writes))
+        {
+            nodes[i].successors.push_back(index);
+            nodes[index].dependency_count++;
+        }
+    }
+
+    remaining.reset(new std::atomic<int>[nodes.size()]);
+}
+
+inline void TaskGraph::run() noexcept
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        remaining[i].store(nodes[i].dependency_count, std::memory_order_relaxed);
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i].dependency_count == 0) schedule(int(i));
+    }
+
+    pool.wait(running);
+}
+
+inline void TaskGraph::schedule(const int index) noexcept
+{
+    pool.enqueue([this, index]() noexcept
+    {
+        nodes[index].work();
+
+        // Successors are enqueued before this task is counted as finished, so 'running' can't complete early.
+        for (const auto successor : nodes[index].successors)
+        {
+            if (remaining[successor].fetch_sub(1, std::memory_order_acq_rel) == 1) schedule(successor);
+        }
+    }, running);
+}
+
+} // namespace Tmpl8
@@ -245,11 +245,109 @@ void swap()
 
 #endif
 
+//Set by --lockstep: draw every frame after its own update instead of overlapping it with the next one
+static bool lockstep = false;
+//Set by --targeting hasher: find the closest enemies with the TanksHasher instead of the KD-trees
+static Game::Targeting targeting = Game::Targeting::KDTree;
+//Set by --reorder <frames>: sort the tanks in memory by position every this many frames, 0 never
+static int reorder_interval = -1;
+//Set by the scenario options, see Scenario
+static Scenario scenario;
+
+// -----------------------------------------------------------
+// Run the game without SDL or a window: frames are rendered into an
+// offscreen surface and never presented. Returns once the game has
+// measured its performance, so only Update/Draw are timed.
+// -----------------------------------------------------------
+int runHeadless()
+{
+    printf("application started (headless).\n");
+    surface = new Surface(SCRWIDTH, SCRHEIGHT);
+    surface->Clear(0);
+    game = new Game(scenario);
+    game->SetTarget(surface);
+    game->SetLockstep(lockstep);
+    game->SetTargeting(targeting);
+    if (reorder_interval >= 0) game->SetReorderInterval(reorder_interval);
+    game->Init();
+    timer t;
+    t.reset();
+    while (!game->Finished())
+    {
+        game->Tick(t.elapsed());
+        t.reset();
+    }
+    game->Shutdown();
+    return 0;
+}
+
+static void printUsage()
+{
+    printf("usage: tmpl_2019-01 [options]\n"
+           "  --headless                   run without a window and exit after the last frame\n"
+           "  --lockstep                   draw every frame after its own update\n"
+           "  --reorder <frames>           sort the tanks in memory every this many frames, 0 never\n"
+           "  --targeting kdtree|hasher    closest enemy engine\n"
+           "  --bench <name>               run a benchmark instead of the game, scaling takes scenario options, grid --threads\n"
+           "scenario options:\n"
+           "  --blue <tanks> --red <tanks> --health <hit points> --frames <frames> --threads <threads>\n"
+           "  --world <x0> <y0> <x1> <y1> --cell-size <pixels> --spacing <pixels> --columns <tanks>\n"
+           "  --scenario <file>            one \"<name> <values>\" per line, e.g. \"blue 5000\"\n");
+}
+
 int main(int argc, char** argv)
 {
 #ifdef _MSC_VER
     redirectIO();
 #endif
+    const auto invalidValue = [](const char* option) {
+        printf("invalid value for %s\n", option);
+        printUsage();
+        return 1;
+    };
+
+    bool headless = false;
+    const char* bench = nullptr;
+    bool scenario_given = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0) headless = true;
+        else if (strcmp(argv[i], "--lockstep") == 0) lockstep = true;
+        else if (strcmp(argv[i], "--reorder") == 0)
+        {
+            //Same rules as the scenario values: a whole, non negative number
+            stringstream value(i + 1 < argc ? argv[++i] : "");
+            int frames = -1;
+            if (!(value >> frames) || !(value >> ws).eof() || frames < 0) return invalidValue("--reorder");
+            reorder_interval = frames;
+        }
+        else if (strcmp(argv[i], "--targeting") == 0)
+        {
+            const char* engine = i + 1 < argc ? argv[++i] : "";
+            if (strcmp(engine, "kdtree") == 0) targeting = Game::Targeting::KDTree;
+            else if (strcmp(engine, "hasher") == 0) targeting = Game::Targeting::TanksHasher;
+            else return invalidValue("--targeting");
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+        {
+            if (i + 1 >= argc) return invalidValue("--bench");
+            bench = argv[++i];
+        }
+        else
+        {
+            //A mistyped option would otherwise run, and measure, the default scenario
+            const Scenario::Option option = scenario.parseOption(argc, argv, i);
+            if (option == Scenario::Option::Unknown) printf("unknown option '%s'\n", argv[i]);
+            if (option != Scenario::Option::Applied)
+            {
+                printUsage();
+                return 1;
+            }
+            scenario_given = true;
+        }
+    }
+    if (bench) return runBenchmark(bench, scenario_given ? &scenario : nullptr);
+    if (headless) return runHeadless();
     printf("application started.\n");
     SDL_Init(SDL_INIT_VIDEO);
 #ifdef ADVANCEDGL
@@ -273,8 +371,11 @@ int main(int argc, char** argv)
     SDL_Texture* frameBuffer = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCRWIDTH, SCRHEIGHT);
 #endif
     int exitapp = 0;
-    game = new Game();
+    game = new Game(scenario);
     game->SetTarget(surface);
+    game->SetLockstep(lockstep);
+    game->SetTargeting(targeting);
+    if (reorder_interval >= 0) game->SetReorderInterval(reorder_interval);
     timer t;
     t.reset();
     while (!exitapp)
@@ -7,16 +7,145 @@ class ThreadPool; //Forward declare
 
 class Worker;
 
+//Type-erased, move-only callable that is stored inline, so queueing a task never allocates
+class Task
+{
+  public:
+    static constexpr size_t storage_size = 112;
+
+    Task() noexcept = default;
+    Task(const Task& other) = delete;
+    Task& operator=(const Task& other) = delete;
+
+    template <class T>
+    void emplace(T&& callable) noexcept
+    {
+        using Callable_T = typename std::decay<T>::type;
+        static_assert(sizeof(Callable_T) <= storage_size, "Task captures too much state to be stored inline, capture by reference instead!");
+        static_assert(alignof(Callable_T) <= alignof(std::max_align_t), "Task callable is over-aligned!");
+
+        new (storage) Callable_T(std::forward<T>(callable));
+        invoke = [](void* storage) noexcept {
+            Callable_T& callable = *reinterpret_cast<Callable_T*>(storage);
+            callable();
+            callable.~Callable_T();
+        };
+    }
+
+    //Runs the stored callable and destroys it, a task can only run once
+    void run() noexcept
+    {
+        invoke(storage);
+        busy.store(false, std::memory_order_release);
+    }
+
+  private:
+    friend class ThreadPool;
+
+    alignas(std::max_align_t) unsigned char storage[storage_size];
+    void (*invoke)(void*) = nullptr;
+    std::atomic<bool> busy{false};
+};
+
+//Fixed capacity Chase-Lev work-stealing deque
+//The owning thread pushes and pops at the bottom, other threads steal from the top
+class TaskDeque
+{
+  public:
+    static constexpr int64_t capacity = 256;
+
+    TaskDeque() noexcept
+    {
+        for (auto& slot : buffer) slot.store(nullptr, std::memory_order_relaxed);
+    }
+
+    //Owner only, returns false when the deque is full
+    bool push(Task* task) noexcept
+    {
+        const int64_t b = bottom.load(std::memory_order_relaxed);
+        const int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= capacity) return false;
+
+        buffer[b & (capacity - 1)].store(task, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    //Owner only
+    Task* pop() noexcept
+    {
+        const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            //Deque was already empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Task* task = buffer[b & (capacity - 1)].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            //Last task, race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                task = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    //Any thread
+    Task* steal() noexcept
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) return nullptr;
+
+        Task* task = buffer[t & (capacity - 1)].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr; //Lost the race to the owner or another thief
+
+        return task;
+    }
+
+  private:
+    std::atomic<int64_t> top{0};
+    char padding[64 - sizeof(std::atomic<int64_t>)]; //Keep the owner and the thieves on separate cache lines
+    std::atomic<int64_t> bottom{0};
+    std::array<std::atomic<Task*>, capacity> buffer;
+};
+
+//Counts the tasks enqueued against it that did not finish yet, see ThreadPool::wait
+class TaskGroup
+{
+  public:
+    bool done() const noexcept { return (pending.load(std::memory_order_acquire) & ~sleeping) == 0; }
+
+  private:
+    friend class ThreadPool;
+
+    //Set in 'pending' while a thread is blocked waiting on this group
+    static constexpr int sleeping = 1 << 30;
+
+    std::atomic<int> pending{0};
+};
+
 class Worker
 {
   public:
     //Instantiate the worker class by passing and storing the threadpool as a reference
-    Worker(ThreadPool& s) : pool(s) {}
+    Worker(ThreadPool& s, size_t index) : pool(s), index(index) {}
 
     inline void operator()();
 
   private:
     ThreadPool& pool;
+    size_t index;
 };
 
 class ThreadPool
@@ -24,76 +153,293 @@ class ThreadPool
   public:
     ThreadPool(size_t numThreads) : stop(false)
     {
+        //One queue per worker, plus one for the thread that owns the pool
+        for (size_t i = 0; i < numThreads + 1; ++i)
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+        owner = std::this_thread::get_id();
+
         for (size_t i = 0; i < numThreads; ++i)
-            workers.push_back(std::thread(Worker(*this)));
+            workers.push_back(std::thread(Worker(*this, i)));
     }
 
     ~ThreadPool()
     {
-        stop = true; // stop all threads
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            stop = true; // stop all threads
+        }
         condition.notify_all();
 
         for (auto& thread : workers)
             thread.join();
     }
 
+    size_t size() const noexcept { return workers.size(); }
+
+    //Index of the calling worker in [0, size()), size() for the thread that owns the pool and -1 for any other thread
+    int threadIndex() const noexcept { return currentQueue(); }
+
     template <class T>
     auto enqueue(T task) -> std::future<decltype(task())>
     {
         //Wrap the function in a packaged_task so we can return a future object
         auto wrapper = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+        auto future = wrapper->get_future();
+
+        push([wrapper]() noexcept {
+            (*wrapper)();
+        });
+
+        return future;
+    }
+
+    //Allocation free alternative to the future returning enqueue, completion is tracked by 'group'
+    template <class T>
+    void enqueue(T task, TaskGroup& group) noexcept
+    {
+        group.pending.fetch_add(1, std::memory_order_relaxed);
 
-        //Scope to restrict critical section
+        push([this, task = std::move(task), &group]() mutable noexcept {
+            task();
+
+            //'group' may be destroyed as soon as it is done, so don't touch it after the decrement
+            if (group.pending.fetch_sub(1, std::memory_order_acq_rel) == (1 | TaskGroup::sleeping))
+            {
+                std::unique_lock<std::mutex> lock(wait_mutex);
+                wait_condition.notify_all();
+            }
+        });
+    }
+
+    //Runs queued tasks on the calling thread until every task of 'group' has finished
+    //When there is nothing left to help with it spins for a while, then blocks until the group is done
+    void wait(TaskGroup& group) noexcept
+    {
+        int idle = 0;
+        while (!group.done())
         {
-            //lock our queue and add the given task to it
-            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (Task* task = findTask(currentQueue()))
+            {
+                task->run();
+                idle = 0;
+            }
+            else if (++idle < spin_count)
+            {
+                _mm_pause();
+            }
+            else
+            {
+                std::unique_lock<std::mutex> lock(wait_mutex);
+
+                int pending = group.pending.load(std::memory_order_acquire);
+                while ((pending & ~TaskGroup::sleeping) != 0 && !group.pending.compare_exchange_weak(pending, pending | TaskGroup::sleeping))
+                    ;
+
+                wait_condition.wait(lock, [&] { return group.done(); });
+            }
+        }
+
+        group.pending.fetch_and(~TaskGroup::sleeping, std::memory_order_relaxed);
+    }
+
+    //Calls 'callable(chunk_begin, chunk_end)' for consecutive chunks of at most 'grain' indices covering [begin, end)
+    //Chunks are claimed dynamically, so threads that finish early take over work from the ones that are behind
+    template <class Callable_T>
+    void parallel_for(int begin, int end, int grain, const Callable_T& callable) noexcept
+    {
+        if (end <= begin) return;
 
-            tasks.push_back([=] {
-                (*wrapper)();
-            });
+        grain = std::max(grain, 1);
+        const int chunks = (end - begin + grain - 1) / grain;
+        if (chunks == 1 || workers.empty())
+        {
+            callable(begin, end);
+            return;
         }
 
-        //Wake up a thread to start this task
-        condition.notify_one();
+        std::atomic<int> next{begin};
+        const auto run = [&]() noexcept {
+            for (int start = next.fetch_add(grain, std::memory_order_relaxed); start < end; start = next.fetch_add(grain, std::memory_order_relaxed))
+            {
+                callable(start, std::min(start + grain, end));
+            }
+        };
 
-        return wrapper->get_future();
+        TaskGroup helpers;
+        const int helper_count = std::min(chunks - 1, int(workers.size()));
+        for (int i = 0; i < helper_count; i++)
+            enqueue(run, helpers);
+
+        run();
+        wait(helpers);
     }
 
   private:
     friend class Worker; //Gives access to the private variables of this class
 
+    static constexpr size_t storage_capacity = 2 * TaskDeque::capacity;
+    static constexpr int spin_count = 2048;
+
+    struct Queue
+    {
+        TaskDeque deque;
+        std::array<Task, storage_capacity> storage; //Ring of inline task storage, only touched by the owner
+        size_t next_storage = 0;
+    };
+
+    struct ThreadState
+    {
+        const ThreadPool* pool = nullptr;
+        size_t index = 0;
+        uint32_t random = 0x9E3779B9u;
+    };
+
+    //Per thread identity, so the deque that a thread owns can be found from any call site
+    static ThreadState& threadState() noexcept
+    {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    //Returns the queue owned by the calling thread, or -1 when it has none
+    int currentQueue() const noexcept
+    {
+        const auto& state = threadState();
+        if (state.pool == this) return int(state.index);
+        if (std::this_thread::get_id() == owner) return int(workers.size());
+        return -1;
+    }
+
+    template <class T>
+    void push(T&& callable) noexcept
+    {
+        if (workers.empty())
+        {
+            //Nobody would pick the task up if the caller blocks on it, so run it right away
+            callable();
+            return;
+        }
+
+        int index = currentQueue();
+
+        //Threads that don't own a queue, and the owning thread, share the last queue behind a mutex
+        const bool shared = (index < 0) || (size_t(index) == workers.size());
+        std::unique_lock<std::mutex> lock(shared_mutex, std::defer_lock);
+        if (shared)
+        {
+            index = int(workers.size());
+            lock.lock();
+        }
+
+        Queue& queue = *queues[index];
+        Task& task = queue.storage[queue.next_storage++ % storage_capacity];
+
+        if (task.busy.load(std::memory_order_acquire))
+        {
+            //Every storage slot is still in flight, run inline instead of allocating
+            if (shared) lock.unlock();
+            callable();
+            return;
+        }
+
+        task.emplace(std::forward<T>(callable));
+        task.busy.store(true, std::memory_order_relaxed);
+
+        if (!queue.deque.push(&task))
+        {
+            if (shared) lock.unlock();
+            task.run();
+            return;
+        }
+
+        if (shared) lock.unlock();
+
+        queued.fetch_add(1, std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) > 0)
+        {
+            //Wake up a thread to start this task
+            std::unique_lock<std::mutex> sleep_lock(sleep_mutex);
+            condition.notify_one();
+        }
+    }
+
+    //Pops from the queue owned by 'index' first, then steals from a random victim
+    Task* findTask(int index) noexcept
+    {
+        Task* task = nullptr;
+
+        if (index >= 0)
+        {
+            //Workers may get here while the constructor is still starting threads, so don't look at 'workers'
+            if (size_t(index) == queues.size() - 1)
+            {
+                std::unique_lock<std::mutex> lock(shared_mutex);
+                task = queues[index]->deque.pop();
+            }
+            else
+            {
+                task = queues[index]->deque.pop();
+            }
+        }
+
+        if (task == nullptr)
+        {
+            auto& random = threadState().random;
+            random ^= random << 13, random ^= random >> 17, random ^= random << 5;
+
+            const size_t count = queues.size();
+            for (size_t i = 0, victim = random % count; i < count && task == nullptr; i++, victim = (victim + 1) % count)
+            {
+                if (int(victim) != index) task = queues[victim]->deque.steal();
+            }
+        }
+
+        if (task != nullptr) queued.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
+
     std::vector<std::thread> workers;
-    std::deque<std::function<void()>> tasks;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::thread::id owner;
+
+    std::mutex shared_mutex; //Serializes the owner side of the shared queue
 
+    std::atomic<int> queued{0};
+    std::atomic<int> sleepers{0};
     std::condition_variable condition; //Wakes up a thread when work is available
+    std::mutex sleep_mutex;
 
-    std::mutex queue_mutex; //Lock for our queue
-    bool stop = false;
+    std::condition_variable wait_condition; //Wakes up threads blocked in wait() when a group finishes
+    std::mutex wait_mutex;
+
+    std::atomic<bool> stop{false};
 };
 
 inline void Worker::operator()()
 {
-    std::function<void()> task;
+    auto& state = ThreadPool::threadState();
+    state.pool = &pool;
+    state.index = index;
+    state.random = 0x9E3779B9u * uint32_t(index + 1);
+
     while (true)
     {
-        //Scope to restrict critical section
-        //This is important because we don't want to hold the lock while executing the task,
-        //because that would make it so only one task can be run simultaneously (aka sequantial)
+        if (Task* task = pool.findTask(int(index)))
         {
-            std::unique_lock<std::mutex> locker(pool.queue_mutex);
-
-            //Wait until some work is ready or we are stopping the threadpool
-            //Because of spurious wakeups we need to check if there is actually a task available or we are stopping
-            pool.condition.wait(locker, [=] { return pool.stop || !pool.tasks.empty(); });
-
-            if (pool.stop) break;
-
-            task = pool.tasks.front();
-            pool.tasks.pop_front();
+            task->run();
+            continue;
         }
 
-        task();
+        //Nothing to run or steal, sleep until a task is pushed or we are stopping the threadpool
+        //Because of spurious wakeups we need to check if there is actually a task available or we are stopping
+        std::unique_lock<std::mutex> locker(pool.sleep_mutex);
+        pool.sleepers.fetch_add(1, std::memory_order_seq_cst);
+        pool.condition.wait(locker, [&] { return pool.stop || pool.queued.load(std::memory_order_seq_cst) > 0; });
+        pool.sleepers.fetch_sub(1, std::memory_order_seq_cst);
+
+        if (pool.stop) break;
     }
 }
 
-} // namespace Tmpl8
\ No newline at end of file
+} // namespace Tmpl8
@@ -0,0 +1,157 @@
+#include "precomp.h" // include (only) this in every .cpp file
+
+namespace Tmpl8
+{
+
+TileRenderer::TileRenderer(const int width, const int height, const int tile_size) noexcept
+    : width(width), height(height), tile_size(tile_size)
+{
+    cols = (width + tile_size - 1) / tile_size;
+    rows = (height + tile_size - 1) / tile_size;
+    tile_start.resize(cols * rows + 1);
+    dirty_start.resize(cols * rows + 1);
+    tile_bytes.resize(cols * rows);
+}
+
+void TileRenderer::begin(const Pixel clear_color) noexcept
+{
+    this->clear_color = clear_color;
+    this->background = nullptr;
+    commands.clear();
+}
+
+void TileRenderer::beginRestore(const Surface* background) noexcept
+{
+    assert(background->GetWidth() == width && background->GetHeight() == height && "TileRenderer restores from a background of another size!");
+
+    this->background = background;
+    commands.clear();
+}
+
+void TileRenderer::submit(const Sprite* sprite, const unsigned int frame, const int x, const int y, const unsigned int flags) noexcept
+{
+    commands.push_back(Command{sprite, frame, x, y, flags});
+}
+
+void TileRenderer::markDirty(const int x1, const int y1, const int x2, const int y2) noexcept
+{
+    dirty.push_back(Rect{max(0, x1), max(0, y1), min(width, x2), min(height, y2)});
+}
+
+long long TileRenderer::bytesWritten() const noexcept
+{
+    return std::accumulate(tile_bytes.begin(), tile_bytes.end(), 0ll);
+}
+
+void TileRenderer::bin(const std::vector<Rect>& rects, std::vector<int>& start, std::vector<int>& indices) noexcept
+{
+    const int tiles = cols * rows;
+    std::fill(start.begin(), start.end(), 0);
+
+    //Empty rects have x2 <= x1 or y2 <= y1, so they don't overlap a single tile
+    const auto forEachTile = [&](const Rect& rect, auto&& callable)
+    {
+        if ((rect.x2 <= rect.x1) || (rect.y2 <= rect.y1)) return;
+        for (int row = rect.y1 / tile_size; row <= (rect.y2 - 1) / tile_size; row++)
+            for (int col = rect.x1 / tile_size; col <= (rect.x2 - 1) / tile_size; col++) callable(row * cols + col);
+    };
+
+    for (const Rect& rect : rects) forEachTile(rect, [&](int tile) { start[tile + 1]++; });
+
+    for (int tile = 0; tile < tiles; tile++) start[tile + 1] += start[tile];
+
+    indices.resize(start[tiles]);
+    write_offsets.assign(start.begin(), start.end() - 1);
+    for (int i = 0; i < int(rects.size()); i++) forEachTile(rects[i], [&](int tile) { indices[write_offsets[tile]++] = i; });
+}
+
+void TileRenderer::clearTile(Surface* target, const Rect& tile) const noexcept
+{
+    Pixel* line = target->GetBuffer() + tile.y1 * target->GetPitch() + tile.x1;
+    for (int y = tile.y1; y < tile.y2; y++, line += target->GetPitch()) std::fill(line, line + (tile.x2 - tile.x1), clear_color);
+}
+
+//Copies the dirty rects of tile 't' from the background a row at a time, or the whole tile when most of it is dirty anyway
+long long TileRenderer::restoreTile(Surface* target, const Rect& tile, const int t) const noexcept
+{
+    const auto copy = [&](const Rect& rect)
+    {
+        const Pixel* src = background->GetBuffer() + rect.y1 * background->GetPitch() + rect.x1;
+        Pixel* dest = target->GetBuffer() + rect.y1 * target->GetPitch() + rect.x1;
+        for (int y = rect.y1; y < rect.y2; y++, src += background->GetPitch(), dest += target->GetPitch()) memcpy(dest, src, (rect.x2 - rect.x1) * sizeof(Pixel));
+        return (long long)(rect.x2 - rect.x1) * (rect.y2 - rect.y1) * sizeof(Pixel);
+    };
+
+    const long long tile_area = (long long)(tile.x2 - tile.x1) * (tile.y2 - tile.y1);
+    if (restore_all) return copy(tile);
+
+    //Overlapping rects are counted twice, that only makes the full copy kick in a bit sooner
+    long long dirty_area = 0;
+    for (int i = dirty_start[t]; i < dirty_start[t + 1]; i++)
+    {
+        const Rect& rect = dirty[dirty_binned[i]];
+        dirty_area += (long long)(min(rect.x2, tile.x2) - max(rect.x1, tile.x1)) * (min(rect.y2, tile.y2) - max(rect.y1, tile.y1));
+    }
+    if (dirty_area >= full_restore_fraction * tile_area) return copy(tile);
+
+    long long bytes = 0;
+    for (int i = dirty_start[t]; i < dirty_start[t + 1]; i++)
+    {
+        const Rect& rect = dirty[dirty_binned[i]];
+        bytes += copy(Rect{max(rect.x1, tile.x1), max(rect.y1, tile.y1), min(rect.x2, tile.x2), min(rect.y2, tile.y2)});
+    }
+    return bytes;
+}
+
+void TileRenderer::render(ThreadPool& pool, Surface* target) noexcept
+{
+    assert(target->GetWidth() == width && target->GetHeight() == height && "TileRenderer renders to a target of another size!");
+
+    //What is on the target is only known when it is the same buffer, restored from the same background, as last time
+    if (target->GetBuffer() != rendered_buffer || background != restored_background) restore_all = true;
+
+    command_rects.resize(commands.size());
+    for (int i = 0; i < int(commands.size()); i++)
+    {
+        const Command& command = commands[i];
+        command_rects[i] = Rect{max(0, command.x), max(0, command.y), min(width, command.x + command.sprite->GetWidth()), min(height, command.y + command.sprite->GetHeight())};
+    }
+
+    bin(command_rects, tile_start, binned);
+    if (background && !restore_all) bin(dirty, dirty_start, dirty_binned);
+
+    pool.parallel_for(0, cols * rows, 1, [&](int first, int last) noexcept
+    {
+        for (int t = first; t < last; t++)
+        {
+            const int x1 = (t % cols) * tile_size, y1 = (t / cols) * tile_size;
+            const Rect tile{x1, y1, min(width, x1 + tile_size), min(height, y1 + tile_size)};
+
+            long long bytes;
+            if (background)
+            {
+                bytes = restoreTile(target, tile, t);
+            }
+            else
+            {
+                clearTile(target, tile);
+                bytes = (long long)(tile.x2 - tile.x1) * (tile.y2 - tile.y1) * sizeof(Pixel);
+            }
+
+            for (int i = tile_start[t]; i < tile_start[t + 1]; i++)
+            {
+                const Command& command = commands[binned[i]];
+                bytes += command.sprite->DrawClipped(target, command.x, command.y, command.frame, command.flags, tile.x1, tile.y1, tile.x2, tile.y2) * sizeof(Pixel);
+            }
+            tile_bytes[t] = bytes;
+        }
+    });
+
+    //The sprites drawn now are what the next render has to restore
+    dirty.assign(command_rects.begin(), command_rects.end());
+    rendered_buffer = target->GetBuffer();
+    restored_background = background;
+    restore_all = false;
+}
+
+} // namespace Tmpl8
@@ -0,0 +1,86 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Records sprite draws for a frame and rasterizes them per screen tile, the tiles in parallel.
+//Every tile draws the draws that overlap it in the order they were submitted, clipped to the tile,
+//so the result is pixel identical to drawing them one after another on a single thread
+class TileRenderer
+{
+
+public:
+
+    TileRenderer(int width, int height, int tile_size) noexcept;
+
+    //Forgets the draws of the last frame, every tile is cleared to 'clear_color' before it is drawn
+    void begin(Pixel clear_color) noexcept;
+
+    //Same, but instead of clearing, the parts of the target that were drawn over since the last render are restored from 'background'.
+    //Anything that changes the target or 'background' outside of the renderer has to be reported with markDirty
+    void beginRestore(const Surface* background) noexcept;
+
+    void submit(const Sprite* sprite, unsigned int frame, int x, int y, unsigned int flags = 0) noexcept;
+
+    //Pixels in [x1, x2) x [y1, y2) of the target or the background changed outside of the renderer, they are restored by the next render
+    void markDirty(int x1, int y1, int x2, int y2) noexcept;
+
+    //Restores the whole background at the next render, e.g. when the target was drawn over without marking it
+    void invalidate() noexcept { restore_all = true; }
+
+    //Draws everything submitted since begin onto 'target', which has to be the size given to the constructor
+    void render(ThreadPool& pool, Surface* target) noexcept;
+
+    int tileCount() const noexcept { return cols * rows; }
+
+    //Bytes the last render wrote to the target, clearing or restoring included
+    long long bytesWritten() const noexcept;
+
+private:
+
+    //A tile is copied from the background as a whole once this fraction of it, or more, is dirty
+    static constexpr float full_restore_fraction = 0.5f;
+
+    struct Rect
+    {
+        int x1, y1, x2, y2;
+    };
+
+    struct Command
+    {
+        const Sprite* sprite;
+        unsigned int frame;
+        int x, y;
+        unsigned int flags;
+    };
+
+    int width, height, tile_size;
+    int cols, rows;
+    Pixel clear_color = 0;
+
+    const Surface* background = nullptr;
+    const Surface* restored_background = nullptr; //Background of the last render
+    const Pixel* rendered_buffer = nullptr;       //Buffer of the target of the last render
+    bool restore_all = true;
+
+    std::vector<Command> commands;
+    std::vector<Rect> command_rects; //Part of each command that is on screen, empty when it is completely off screen
+    std::vector<int> tile_start;     //Commands of tile t are binned[tile_start[t]] up to binned[tile_start[t+1]]
+    std::vector<int> binned;         //Command indices ordered by tile, in submission order within a tile
+
+    std::vector<Rect> dirty;         //Drawn over since the last render
+    std::vector<int> dirty_start;    //Same as tile_start and binned, for the dirty rects
+    std::vector<int> dirty_binned;
+
+    std::vector<int> write_offsets;  //Reused by the binning
+    std::vector<long long> tile_bytes; //Written per tile by the last render
+
+    //Counting sort of 'rects' by tile, a rect that overlaps several tiles is placed in each of them
+    void bin(const std::vector<Rect>& rects, std::vector<int>& start, std::vector<int>& indices) noexcept;
+
+    void clearTile(Surface* target, const Rect& tile) const noexcept;
+    long long restoreTile(Surface* target, const Rect& tile, int t) const noexcept;
+
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,240 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Grid that is rebuilt from scratch instead of updated: a parallel counting sort places all entries in one array ordered by cell.
+//Queries don't need locks and read each row of cells as one contiguous range.
+//Entries can be split into partitions, e.g. teams, that are stored as separate runs within every cell so a query can skip the ones it doesn't want
+template <typename T>
+class UniformGrid
+{
+
+public:
+
+    struct Entry
+    {
+        vec2 position;
+        T object;
+    };
+
+    UniformGrid(BoundingBox boundary, float cellSize, int partitions = 1) noexcept;
+
+    //Replaces the contents with entryAt(0) .. entryAt(count-1), entries outside of the boundary are left out
+    template <typename Callable_T>
+    void rebuild(ThreadPool& pool, int count, const Callable_T& entryAt) noexcept;
+
+    //Same, with entry i placed in partition partitionOf(i)
+    template <typename Callable_T, typename Partition_T>
+    void rebuild(ThreadPool& pool, int count, const Callable_T& entryAt, const Partition_T& partitionOf) noexcept;
+
+    template <typename Callable_T>
+    void forEachWithinBounds(BoundingBox boundary, const Callable_T& callable) const noexcept;
+
+    //Only visits the entries in partitions first_partition up to and including last_partition
+    template <typename Callable_T>
+    void forEachWithinBounds(BoundingBox boundary, int first_partition, int last_partition, const Callable_T& callable) const noexcept;
+
+    const BoundingBox& getBoundary() const noexcept { return boundary; }
+    int size() const noexcept { return int(entries.size()); }
+
+    //Chunks the last rebuild counted and scattered in parallel
+    int chunkCount() const noexcept { return chunk_count; }
+
+private:
+
+    //Fewer objects than this per chunk aren't worth a separate histogram
+    static constexpr int min_chunk_size = 1024;
+    //Histogram entries of all chunks together, 16 MB of counts. Only huge, sparse worlds get fewer chunks because of it
+    static constexpr size_t max_histogram_size = size_t(1) << 22;
+    //Runs per block of the prefix sum over the histograms
+    static constexpr int scan_block_size = 4096;
+
+    BoundingBox boundary;
+    float cellSize;
+
+    int rows, cols;
+    int partitions;
+    std::vector<Entry> entries;
+    std::vector<int> run_start; //Entries of partition p in cell c are [run_start[c*partitions+p], run_start[c*partitions+p+1])
+
+    std::vector<int> run_of;     //Run of every object of the last rebuild, -1 when outside of the boundary
+    std::vector<int> histograms; //One row of counts, later write offsets, per chunk
+    std::vector<int> block_offsets; //Objects before every block of runs, for the prefix sum
+    int chunk_count = 1;
+
+    int calculateIndex(vec2 position) const noexcept;
+
+};
+
+template <typename T>
+inline UniformGrid<T>::UniformGrid(BoundingBox boundary, float cellSize, int partitions) noexcept
+{
+    this->boundary = boundary;
+    this->cellSize = cellSize;
+
+    this->rows = ceil((boundary.max.y+1 - boundary.min.y) / this->cellSize);
+    this->cols = ceil((boundary.max.x+1 - boundary.min.x) / this->cellSize);
+    this->partitions = partitions;
+
+    this->run_start = std::vector<int>(rows*cols*partitions + 1, 0);
+}
+
+template <typename T>
+template <typename Callable_T>
+inline void UniformGrid<T>::rebuild(ThreadPool& pool, const int count, const Callable_T& entryAt) noexcept
+{
+    rebuild(pool, count, entryAt, [](int) noexcept { return 0; });
+}
+
+template <typename T>
+template <typename Callable_T, typename Partition_T>
+inline void UniformGrid<T>::rebuild(ThreadPool& pool, const int count, const Callable_T& entryAt, const Partition_T& partitionOf) noexcept
+{
+    const int run_count = rows * cols * partitions;
+    chunk_count = std::max(1, std::min(int(pool.size()) + 1, count / min_chunk_size));
+    chunk_count = std::max(1, std::min(chunk_count, int(max_histogram_size / run_count)));
+    const int chunk_size = (count + chunk_count - 1) / chunk_count;
+
+    run_of.resize(count);
+    histograms.assign(size_t(chunk_count) * run_count, 0);
+
+    // Count the objects per run, every chunk into its own histogram.
+    pool.parallel_for(0, chunk_count, 1, [&](int first, int last) noexcept
+    {
+        for (int chunk = first; chunk < last; chunk++)
+        {
+            int* histogram = &histograms[size_t(chunk) * run_count];
+            const int end = std::min(count, (chunk + 1) * chunk_size);
+            for (int i = chunk * chunk_size; i < end; i++)
+            {
+                const vec2 position = entryAt(i).position;
+                const int partition = partitionOf(i);
+                assert(partition >= 0 && partition < partitions && "'partitionOf' returned a partition UniformGrid doesn't have!");
+
+                const int run = contains(boundary, position) ? calculateIndex(position) * partitions + partition : -1;
+                run_of[i] = run;
+                if (run >= 0) histogram[run]++;
+            }
+        }
+    });
+
+    // Prefix sum over the runs, and within a run over the chunks, turns the counts into write offsets.
+    // Done in two parallel passes over blocks of runs: the first sums every block, the second scans each block from the objects before it.
+    const int block_count = (run_count + scan_block_size - 1) / scan_block_size;
+    block_offsets.assign(block_count + 1, 0);
+
+    pool.parallel_for(0, block_count, 1, [&](int first, int last) noexcept
+    {
+        for (int block = first; block < last; block++)
+        {
+            const int end = std::min(run_count, (block + 1) * scan_block_size);
+            int objects = 0;
+            for (int chunk = 0; chunk < chunk_count; chunk++)
+            {
+                const int* histogram = &histograms[size_t(chunk) * run_count];
+                for (int run = block * scan_block_size; run < end; run++) objects += histogram[run];
+            }
+            block_offsets[block + 1] = objects;
+        }
+    });
+
+    for (int block = 0; block < block_count; block++) block_offsets[block + 1] += block_offsets[block];
+
+    pool.parallel_for(0, block_count, 1, [&](int first, int last) noexcept
+    {
+        for (int block = first; block < last; block++)
+        {
+            const int end = std::min(run_count, (block + 1) * scan_block_size);
+            int offset = block_offsets[block];
+            for (int run = block * scan_block_size; run < end; run++)
+            {
+                run_start[run] = offset;
+                for (int chunk = 0; chunk < chunk_count; chunk++)
+                {
+                    int& histogram = histograms[size_t(chunk) * run_count + run];
+                    const int objects = histogram;
+                    histogram = offset;
+                    offset += objects;
+                }
+            }
+        }
+    });
+
+    const int total = block_offsets[block_count];
+    run_start[run_count] = total;
+    entries.resize(total);
+
+    // Scatter, every chunk owns its write offsets so this needs no synchronisation and keeps the object order within a run.
+    pool.parallel_for(0, chunk_count, 1, [&](int first, int last) noexcept
+    {
+        for (int chunk = first; chunk < last; chunk++)
+        {
+            int* offsets = &histograms[size_t(chunk) * run_count];
+            const int end = std::min(count, (chunk + 1) * chunk_size);
+            for (int i = chunk * chunk_size; i < end; i++)
+            {
+                const int run = run_of[i];
+                if (run >= 0) entries[offsets[run]++] = entryAt(i);
+            }
+        }
+    });
+}
+
+template <typename T>
+template <typename Callable_T>
+inline void UniformGrid<T>::forEachWithinBounds(BoundingBox boundary, const Callable_T& callable) const noexcept
+{
+    forEachWithinBounds(boundary, 0, partitions - 1, callable);
+}
+
+template <typename T>
+template <typename Callable_T>
+inline void UniformGrid<T>::forEachWithinBounds(BoundingBox boundary, const int first_partition, const int last_partition, const Callable_T& callable) const noexcept
+{
+    boundary.min = {max(this->boundary.min.x, boundary.min.x), max(this->boundary.min.y, boundary.min.y)};
+    boundary.max = {min(this->boundary.max.x, boundary.max.x), min(this->boundary.max.y, boundary.max.y)};
+
+    const auto y0 = int((boundary.min.y - this->boundary.min.y) / cellSize);
+    const auto x0 = int((boundary.min.x - this->boundary.min.x) / cellSize);
+    const auto yE = int((boundary.max.y - this->boundary.min.y) / cellSize);
+    const auto xE = int((boundary.max.x - this->boundary.min.x) / cellSize);
+
+    if (x0 > xE) return;
+
+    const auto visit = [&](int begin, int end)
+    {
+        for (auto index = begin; index < end; index++)
+        {
+            const auto& entry = entries[index];
+            if (contains(boundary, entry.position))
+                callable(entry);
+        }
+    };
+
+    const bool all_partitions = first_partition == 0 && last_partition == partitions - 1;
+    for (auto y = y0; y <= yE; y++)
+    {
+        if (all_partitions)
+        {
+            // The cells x0..xE of a row are stored back to back.
+            visit(run_start[(y*cols + x0) * partitions], run_start[(y*cols + xE + 1) * partitions]);
+            continue;
+        }
+
+        for (auto x = x0; x <= xE; x++)
+        {
+            const auto cell = (y*cols + x) * partitions;
+            visit(run_start[cell + first_partition], run_start[cell + last_partition + 1]);
+        }
+    }
+}
+
+template <typename T>
+inline int UniformGrid<T>::calculateIndex(vec2 position) const noexcept
+{
+    assert(contains(boundary, position) && "'position' should be within the boundaries of UniformGrid!");
+    return (int((position.y - boundary.min.y) / cellSize) * cols) + int((position.x - boundary.min.x) / cellSize);
+}
+
+} // namespace Tmpl8